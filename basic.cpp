@@ -1,6 +1,9 @@
+#define MEMORY_DEBUG_IMPLEMENTATION
 #include "basic.h"
 #include "arena.h"
 #include "std_allocator.h"
 
-Allocator* Allocator_Persistent = new AllocatorPersistent();
+Allocator* Allocator_Persistent = new AllocatorPersistent(MEMORY_TAG_CONTAINERS);
+Allocator* Allocator_Text       = new AllocatorPersistent(MEMORY_TAG_TEXT);
+Allocator* Allocator_Render     = new AllocatorPersistent(MEMORY_TAG_RENDER);
 Allocator* Allocator_Temp       = new Arena();
\ No newline at end of file
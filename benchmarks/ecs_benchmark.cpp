@@ -0,0 +1,596 @@
+// Headless ECS benchmark, no window, renderer or SDL. Built as one translation unit together with the ECS sources:
+//   clang++ -std=c++20 -O2 benchmarks/ecs_benchmark.cpp (with the modules from include/ precompiled as for the game)
+// Usage: ecs_benchmark [--entities N] [--rounds N] [--out file.json]
+// Every scenario reports ns per operation, allocation calls and bytes made by the ECS and the peak RSS after it, as JSON.
+// Iteration scenarios report the best of the rounds, the others run once.
+
+#if defined(_WIN32)
+    #define NOMINMAX
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+#endif
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+// Every allocation of the ECS, its containers and the temp arena goes through these.
+static u64 Benchmark_Allocations;
+static u64 Benchmark_Allocated_Bytes;
+
+static inline void* benchmark_malloc(u64 size) {
+    Benchmark_Allocations++;
+    Benchmark_Allocated_Bytes += size;
+    return malloc(size);
+}
+
+static inline void* benchmark_realloc(void* ptr, u64 size) {
+    Benchmark_Allocations++;
+    Benchmark_Allocated_Bytes += size;
+    return realloc(ptr, size);
+}
+
+#define ALLOCATOR_STD_CUSTOM_MALLOC
+#define Allocator_Std_Malloc(size)       benchmark_malloc(size)
+#define Allocator_Std_Realloc(ptr, size) benchmark_realloc(ptr, size)
+#define Allocator_Std_Free(ptr)          ::free(ptr)
+
+#define ARENA_CUSTOM_MALLOC
+#define Arena_Malloc(type, size)       (type*)benchmark_malloc(size)
+#define Arena_Realloc(type, ptr, size) (type*)benchmark_realloc(ptr, size)
+#define Arena_Free(ptr)                ::free(ptr)
+
+#define COMPONENTS_CUSTOM_MALLOC
+#define COMPONENTS_MALLOC(type, size)  (type*)benchmark_malloc(size)
+#define COMPONENTS_FREE(ptr)           ::free(ptr)
+#define COMPONENTS_REALLOC(ptr, size)  benchmark_realloc(ptr, size)
+
+#define JOBS_IMPLEMENTATION
+
+#include "../basic.cpp"
+#include "../components.cpp"
+#include "../entities.cpp"
+
+#define BENCHMARK_DEFAULT_ENTITIES  1000000
+#define BENCHMARK_DEFAULT_ROUNDS    5
+#define BENCHMARK_MAX_RESULTS       32
+#define BENCHMARK_SHARED_VALUES     16   // distinct Renderer2D values
+#define BENCHMARK_ECB_BATCH         4096 // entities recorded into one command buffer
+#define BENCHMARK_FRAGMENT_BITS     5    // optional components spreading entities over 2^bits archetypes
+
+struct BenchmarkResult {
+    const char* name;
+    u64         ops;
+    double      ns_per_op;
+    u64         allocations;
+    u64         allocated_bytes;
+    u64         peak_rss_kb;
+};
+
+struct Benchmark {
+    EntityManager   em;
+    EntityHandle*   handles;
+    u32             entities;
+    u32             rounds;
+    BenchmarkResult results[BENCHMARK_MAX_RESULTS];
+    u32             results_count;
+    u64             allocations;     // counters at the start of the running scenario
+    u64             allocated_bytes;
+};
+
+typedef std::chrono::steady_clock::time_point BenchmarkTime;
+
+static volatile u64 Benchmark_Sink; // keeps iteration results alive
+
+static u64 peak_rss_kb() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#elif defined(__APPLE__)
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#endif
+}
+
+static inline BenchmarkTime benchmark_now() {
+    return std::chrono::steady_clock::now();
+}
+
+static inline double benchmark_ns(BenchmarkTime start, BenchmarkTime end) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+static void benchmark_begin(Benchmark* bench) {
+    bench->allocations     = Benchmark_Allocations;
+    bench->allocated_bytes = Benchmark_Allocated_Bytes;
+}
+
+static void benchmark_end(Benchmark* bench, const char* name, u64 ops, double ns) {
+    Assert(bench->results_count < BENCHMARK_MAX_RESULTS, "Too many benchmark scenarios.");
+
+    bench->results[bench->results_count++] = {
+        .name            = name,
+        .ops             = ops,
+        .ns_per_op       = ops ? ns / (double)ops : 0.0,
+        .allocations     = Benchmark_Allocations - bench->allocations,
+        .allocated_bytes = Benchmark_Allocated_Bytes - bench->allocated_bytes,
+        .peak_rss_kb     = peak_rss_kb(),
+    };
+
+    fprintf(stderr, "%-24s %10llu ops %10.2f ns/op\n", name, (unsigned long long)ops, ops ? ns / (double)ops : 0.0);
+}
+
+static Renderer2D benchmark_renderer(u32 i) {
+    return Renderer2D {
+        .shape    = NULL,
+        .material = (Material*)(uintptr_t)(i % BENCHMARK_SHARED_VALUES + 1),
+    };
+}
+
+// Spawns the whole population with every data component, so the same entities serve the 2, 4 and 8 component queries.
+static void benchmark_spawn_full(Benchmark* bench) {
+    u32 count = bench->entities;
+
+    Transform*      transforms = (Transform*)malloc(sizeof(Transform) * count);
+    TestComponent*  tests      = (TestComponent*)malloc(sizeof(TestComponent) * count);
+    TestComponent2* tests2     = (TestComponent2*)malloc(sizeof(TestComponent2) * count);
+    Renderer2D*     renderers  = (Renderer2D*)malloc(sizeof(Renderer2D) * count);
+
+    Assert(transforms && tests && tests2 && renderers, "Cannot allocate benchmark spawn data.");
+
+    for (u32 i = 0; i < count; i++) {
+        transforms[i] = { .position = {{(float)i, 0, 0}}, .rotation = quaternion_identity, .scale = {{1, 1, 1}} };
+        tests[i]      = { .a = i, .b = 1 };
+        tests2[i]     = { .c = i };
+        renderers[i]  = benchmark_renderer(i);
+    }
+
+    Archetype archetype = QUERY_MASK(GET_COMPONENT_BIT(Transform),
+                                     GET_COMPONENT_BIT(WorldTransform),
+                                     GET_COMPONENT_BIT(TestComponent),
+                                     GET_COMPONENT_BIT(TestComponent2),
+                                     GET_COMPONENT_BIT(TestComponent3),
+                                     GET_COMPONENT_BIT(TestComponent4),
+                                     GET_COMPONENT_BIT(Parent),
+                                     GET_COMPONENT_BIT(Renderer2D));
+
+    ComponentSpan spans[] = {
+        COMPONENT_SPAN(Transform,      transforms),
+        COMPONENT_SPAN(TestComponent,  tests),
+        COMPONENT_SPAN(TestComponent2, tests2),
+        COMPONENT_SPAN(Renderer2D,     renderers),
+    };
+
+    benchmark_begin(bench);
+
+    BenchmarkTime start = benchmark_now();
+    entity_create_batch(&bench->em, count, archetype, bench->handles, spans, sizeof(spans) / sizeof(ComponentSpan));
+    BenchmarkTime end = benchmark_now();
+
+    benchmark_end(bench, "spawn_batch", count, benchmark_ns(start, end));
+
+    free(transforms);
+    free(tests);
+    free(tests2);
+    free(renderers);
+    free_temp_allocator();
+}
+
+static void benchmark_spawn_single(Benchmark* bench) {
+    EntityManager* em = &bench->em;
+
+    benchmark_begin(bench);
+
+    BenchmarkTime start = benchmark_now();
+
+    for (u32 i = 0; i < bench->entities; i++) {
+        EntityHandle handle = entity_create(em);
+
+        ADD_COMPONENT(Transform, em, handle.id, (Transform{ .position = {{0, 0, 0}}, .rotation = quaternion_identity, .scale = {{1, 1, 1}} }));
+        ADD_COMPONENT(TestComponent, em, handle.id, (TestComponent{ .a = i, .b = 0 }));
+
+        bench->handles[i] = handle;
+    }
+
+    BenchmarkTime end = benchmark_now();
+
+    benchmark_end(bench, "spawn_single", bench->entities, benchmark_ns(start, end));
+}
+
+static void benchmark_destroy(Benchmark* bench, const char* name) {
+    benchmark_begin(bench);
+
+    BenchmarkTime start = benchmark_now();
+    entity_destroy_batch(&bench->em, bench->handles, bench->entities);
+    BenchmarkTime end = benchmark_now();
+
+    benchmark_end(bench, name, bench->entities, benchmark_ns(start, end));
+}
+
+// Adds and removes a sparse component on every entity, then moves every entity between two archetypes.
+static void benchmark_churn(Benchmark* bench) {
+    EntityManager* em    = &bench->em;
+    u32            count = bench->entities;
+
+    benchmark_begin(bench);
+
+    BenchmarkTime start = benchmark_now();
+
+    for (u32 i = 0; i < count; i++) {
+        ADD_COMPONENT(TestComponent2, em, bench->handles[i].id, (TestComponent2{ .c = i }));
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        REMOVE_COMPONENT(TestComponent2, em, bench->handles[i].id);
+    }
+
+    BenchmarkTime end = benchmark_now();
+
+    benchmark_end(bench, "churn_sparse", count * 2, benchmark_ns(start, end));
+
+    benchmark_begin(bench);
+
+    start = benchmark_now();
+
+    for (u32 i = 0; i < count; i++) {
+        ADD_COMPONENT(WorldTransform, em, bench->handles[i].id, (WorldTransform{ matrix4_identity }));
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        REMOVE_COMPONENT(WorldTransform, em, bench->handles[i].id);
+    }
+
+    end = benchmark_now();
+
+    benchmark_end(bench, "churn_chunk", count * 2, benchmark_ns(start, end));
+
+    benchmark_begin(bench);
+
+    start = benchmark_now();
+
+    // One command buffer per batch of entities, played back and dropped like a frame would.
+    for (u32 first = 0; first < count; first += BENCHMARK_ECB_BATCH) {
+        u32 last = min(first + BENCHMARK_ECB_BATCH, count);
+
+        EntityCommandBuffer ecb;
+        ecb_make(&ecb, em);
+
+        for (u32 i = first; i < last; i++) {
+            ECB_ADD_COMPONENT(TestComponent2, &ecb, bench->handles[i], (TestComponent2{ .c = i }));
+            ECB_ADD_COMPONENT(WorldTransform, &ecb, bench->handles[i], (WorldTransform{ matrix4_identity }));
+        }
+
+        ecb_playback(&ecb);
+
+        for (u32 i = first; i < last; i++) {
+            ECB_REMOVE_COMPONENT(TestComponent2, &ecb, bench->handles[i]);
+            ECB_REMOVE_COMPONENT(WorldTransform, &ecb, bench->handles[i]);
+        }
+
+        ecb_playback(&ecb);
+        ecb_free(&ecb);
+        free_temp_allocator();
+    }
+
+    end = benchmark_now();
+
+    benchmark_end(bench, "churn_ecb", count * 4, benchmark_ns(start, end));
+}
+
+static void benchmark_iterate_2(Benchmark* bench, Query* query) {
+    double best = 0;
+
+    benchmark_begin(bench);
+
+    for (u32 round = 0; round < bench->rounds; round++) {
+        BenchmarkTime start = benchmark_now();
+        u64           sum   = 0;
+
+        BEGIN_ITERATE_QUERY_2(query, Transform, WorldTransform)
+            WorldTransform_c->matrix.e[12] = Transform_c->position.x;
+            sum += entity;
+        END_ITERATE_QUERY()
+
+        double ns = benchmark_ns(start, benchmark_now());
+
+        if (round == 0 || ns < best) best = ns;
+        Benchmark_Sink = Benchmark_Sink + sum;
+    }
+
+    benchmark_end(bench, "iterate_2", bench->entities, best);
+}
+
+static void benchmark_iterate_2_sparse(Benchmark* bench, Query* query) {
+    double best = 0;
+
+    benchmark_begin(bench);
+
+    for (u32 round = 0; round < bench->rounds; round++) {
+        BenchmarkTime start = benchmark_now();
+        u64           sum   = 0;
+
+        BEGIN_ITERATE_QUERY_2(query, TestComponent, TestComponent2)
+            sum += TestComponent_c->a + TestComponent2_c->c;
+        END_ITERATE_QUERY()
+
+        double ns = benchmark_ns(start, benchmark_now());
+
+        if (round == 0 || ns < best) best = ns;
+        Benchmark_Sink = Benchmark_Sink + sum;
+    }
+
+    benchmark_end(bench, "iterate_2_sparse", bench->entities, best);
+}
+
+static void benchmark_iterate_2_group(Benchmark* bench) {
+    Group  group;
+    double best = 0;
+
+    group_make(&group, QUERY_MASK(GET_COMPONENT_BIT(TestComponent), GET_COMPONENT_BIT(TestComponent2)));
+
+    benchmark_begin(bench);
+
+    for (u32 round = 0; round < bench->rounds; round++) {
+        BenchmarkTime start = benchmark_now();
+        u64           sum   = 0;
+
+        BEGIN_ITERATE_GROUP_2(&group, TestComponent, TestComponent2)
+            sum += TestComponent_c->a + TestComponent2_c->c;
+        END_ITERATE_GROUP()
+
+        double ns = benchmark_ns(start, benchmark_now());
+
+        if (round == 0 || ns < best) best = ns;
+        Benchmark_Sink = Benchmark_Sink + sum;
+    }
+
+    benchmark_end(bench, "iterate_2_group", group.count, best);
+
+    group_free(&group);
+}
+
+static void benchmark_iterate_4(Benchmark* bench, Query* query) {
+    double best = 0;
+
+    benchmark_begin(bench);
+
+    for (u32 round = 0; round < bench->rounds; round++) {
+        BenchmarkTime start = benchmark_now();
+        u64           sum   = 0;
+
+        BEGIN_ITERATE_QUERY_2(query, Transform, WorldTransform)
+            TestComponent*  test  = component_table_get<TestComponent>(&TestComponent_s, entity);
+            TestComponent2* test2 = component_table_get<TestComponent2>(&TestComponent2_s, entity);
+
+            WorldTransform_c->matrix.e[12] = Transform_c->position.x;
+            sum += test->a + test2->c;
+        END_ITERATE_QUERY()
+
+        double ns = benchmark_ns(start, benchmark_now());
+
+        if (round == 0 || ns < best) best = ns;
+        Benchmark_Sink = Benchmark_Sink + sum;
+    }
+
+    benchmark_end(bench, "iterate_4", bench->entities, best);
+}
+
+static void benchmark_iterate_8(Benchmark* bench, Query* query) {
+    double best = 0;
+
+    benchmark_begin(bench);
+
+    for (u32 round = 0; round < bench->rounds; round++) {
+        BenchmarkTime start = benchmark_now();
+        u64           sum   = 0;
+
+        BEGIN_ITERATE_QUERY_2(query, Transform, WorldTransform)
+            TestComponent*  test     = component_table_get<TestComponent>(&TestComponent_s, entity);
+            TestComponent2* test2    = component_table_get<TestComponent2>(&TestComponent2_s, entity);
+            TestComponent3* test3    = component_table_get<TestComponent3>(&TestComponent3_s, entity);
+            TestComponent4* test4    = component_table_get<TestComponent4>(&TestComponent4_s, entity);
+            Parent*         parent   = component_table_get<Parent>(&Parent_s, entity);
+            Renderer2D*     renderer = component_table_get<Renderer2D>(&Renderer2D_s, entity);
+
+            WorldTransform_c->matrix.e[12] = Transform_c->position.x;
+            sum += test->a + test2->c + test3->a + test4->a + parent->entity + (uintptr_t)renderer->material;
+        END_ITERATE_QUERY()
+
+        double ns = benchmark_ns(start, benchmark_now());
+
+        if (round == 0 || ns < best) best = ns;
+        Benchmark_Sink = Benchmark_Sink + sum;
+    }
+
+    benchmark_end(bench, "iterate_8", bench->entities, best);
+}
+
+// Spreads the population over 2^BENCHMARK_FRAGMENT_BITS archetypes, entity i gets the optional components of the bits of i.
+static void benchmark_fragmented(Benchmark* bench) {
+    EntityManager* em    = &bench->em;
+    u32            count = bench->entities;
+
+    u32 optional[BENCHMARK_FRAGMENT_BITS] = {
+        GET_COMPONENT_BIT(TestComponent),
+        GET_COMPONENT_BIT(TestComponent2),
+        GET_COMPONENT_BIT(TestComponent3),
+        GET_COMPONENT_BIT(TestTag),
+        GET_COMPONENT_BIT(WorldTransform),
+    };
+
+    u32 archetypes_count = 1 << BENCHMARK_FRAGMENT_BITS;
+    u32 per_archetype    = count / archetypes_count;
+
+    benchmark_begin(bench);
+
+    BenchmarkTime start = benchmark_now();
+
+    for (u32 a = 0; a < archetypes_count; a++) {
+        Archetype archetype = QUERY_MASK(GET_COMPONENT_BIT(Transform));
+
+        for (u32 bit = 0; bit < BENCHMARK_FRAGMENT_BITS; bit++) {
+            if (a & (1 << bit)) bitmap_set_bit(archetype, optional[bit]);
+        }
+
+        u32 first = a * per_archetype;
+        u32 spawn = a + 1 == archetypes_count ? count - first : per_archetype;
+
+        entity_create_batch(em, spawn, archetype, bench->handles + first);
+    }
+
+    BenchmarkTime end = benchmark_now();
+
+    benchmark_end(bench, "spawn_fragmented", count, benchmark_ns(start, end));
+
+    Query  query;
+    double best = 0;
+
+    query_make(em, &query, QUERY_MASK(GET_COMPONENT_BIT(Transform)));
+
+    benchmark_begin(bench);
+
+    for (u32 round = 0; round < bench->rounds; round++) {
+        BenchmarkTime round_start = benchmark_now();
+        u64           sum         = 0;
+
+        BEGIN_ITERATE_QUERY(&query, Transform)
+            Transform_c->position.x += 1.0f;
+            sum += entity;
+        END_ITERATE_QUERY()
+
+        double ns = benchmark_ns(round_start, benchmark_now());
+
+        if (round == 0 || ns < best) best = ns;
+        Benchmark_Sink = Benchmark_Sink + sum;
+    }
+
+    benchmark_end(bench, "iterate_fragmented", count, best);
+
+    query_free(em, &query);
+    free_temp_allocator();
+}
+
+static void benchmark_write_json(Benchmark* bench, FILE* out) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"benchmark\": \"ecs\",\n");
+    fprintf(out, "  \"entities\": %u,\n", bench->entities);
+    fprintf(out, "  \"rounds\": %u,\n", bench->rounds);
+    fprintf(out, "  \"peak_rss_kb\": %llu,\n", (unsigned long long)peak_rss_kb());
+    fprintf(out, "  \"scenarios\": [\n");
+
+    for (u32 i = 0; i < bench->results_count; i++) {
+        BenchmarkResult* result = &bench->results[i];
+
+        fprintf(out, "    { \"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"allocations\": %llu, \"allocated_bytes\": %llu, \"peak_rss_kb\": %llu }%s\n",
+                result->name,
+                (unsigned long long)result->ops,
+                result->ns_per_op,
+                (unsigned long long)result->allocations,
+                (unsigned long long)result->allocated_bytes,
+                (unsigned long long)result->peak_rss_kb,
+                i + 1 < bench->results_count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+int main(int argc, char** argv) {
+    static Benchmark bench;
+
+    const char* out_path = NULL;
+
+    bench.entities = BENCHMARK_DEFAULT_ENTITIES;
+    bench.rounds   = BENCHMARK_DEFAULT_ROUNDS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--entities") == 0 && i + 1 < argc) {
+            bench.entities = (u32)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            bench.rounds = (u32)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--entities N] [--rounds N] [--out file.json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (bench.entities < (1u << BENCHMARK_FRAGMENT_BITS)) bench.entities = 1 << BENCHMARK_FRAGMENT_BITS;
+    if (bench.rounds == 0) bench.rounds = 1;
+
+    bench.handles = (EntityHandle*)malloc(sizeof(EntityHandle) * bench.entities);
+    Assert(bench.handles, "Cannot allocate benchmark entity handles.");
+
+    entity_manager_make(&bench.em);
+
+    Query query_2;
+    Query query_2_sparse;
+    Query query_4;
+    Query query_8;
+
+    query_make(&bench.em, &query_2, QUERY_MASK(GET_COMPONENT_BIT(Transform), GET_COMPONENT_BIT(WorldTransform)));
+    query_make(&bench.em, &query_2_sparse, QUERY_MASK(GET_COMPONENT_BIT(TestComponent), GET_COMPONENT_BIT(TestComponent2)));
+    query_make(&bench.em, &query_4, QUERY_MASK(GET_COMPONENT_BIT(Transform),
+                                               GET_COMPONENT_BIT(WorldTransform),
+                                               GET_COMPONENT_BIT(TestComponent),
+                                               GET_COMPONENT_BIT(TestComponent2)));
+    query_make(&bench.em, &query_8, QUERY_MASK(GET_COMPONENT_BIT(Transform),
+                                               GET_COMPONENT_BIT(WorldTransform),
+                                               GET_COMPONENT_BIT(TestComponent),
+                                               GET_COMPONENT_BIT(TestComponent2),
+                                               GET_COMPONENT_BIT(TestComponent3),
+                                               GET_COMPONENT_BIT(TestComponent4),
+                                               GET_COMPONENT_BIT(Parent),
+                                               GET_COMPONENT_BIT(Renderer2D)));
+
+    benchmark_spawn_single(&bench);
+    benchmark_churn(&bench);
+    benchmark_destroy(&bench, "destroy_single");
+
+    benchmark_spawn_full(&bench);
+    benchmark_iterate_2(&bench, &query_2);
+    benchmark_iterate_2_sparse(&bench, &query_2_sparse);
+    benchmark_iterate_2_group(&bench);
+    benchmark_iterate_4(&bench, &query_4);
+    benchmark_iterate_8(&bench, &query_8);
+    benchmark_destroy(&bench, "destroy_full");
+
+    benchmark_fragmented(&bench);
+    benchmark_destroy(&bench, "destroy_fragmented");
+
+    query_free(&bench.em, &query_2);
+    query_free(&bench.em, &query_2_sparse);
+    query_free(&bench.em, &query_4);
+    query_free(&bench.em, &query_8);
+
+    if (out_path) {
+        FILE* out = fopen(out_path, "w");
+
+        if (out == NULL) {
+            fprintf(stderr, "Cannot open %s.\n", out_path);
+            return 1;
+        }
+
+        benchmark_write_json(&bench, out);
+        fclose(out);
+    } else {
+        benchmark_write_json(&bench, stdout);
+    }
+
+    free(bench.handles);
+
+    return 0;
+}
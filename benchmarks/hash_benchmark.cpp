@@ -0,0 +1,208 @@
+// Hash function benchmark, no window, renderer or SDL. Built together with basic.cpp for the allocators:
+//   clang++ -std=c++20 -O2 -Iinclude -I. benchmarks/hash_benchmark.cpp basic.cpp (with the modules from include/ precompiled as for the game)
+// Usage: hash_benchmark
+
+#define TEXT_IMPLEMENTATION
+#define BITMAP_IMPLEMENTATION
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "basic.h"
+#include "assert.h"
+#include "debug.h"
+#include "hash_functions.h"
+
+import list;
+import text;
+import bitmap;
+import hash_table;
+
+// Compares the hash functions HashTable uses against the previous ones on key sets the engine actually has:
+// dense and strided entity ids, archetype bitmaps with a few low bits set, and uniform names.
+// Prints full hash collisions, probe lengths in 16 slot groups, tag false positives and insert + lookup time.
+
+#define BENCHMARK_KEYS_COUNT 100000
+#define BENCHMARK_ROUNDS     8
+
+// Previous hash functions, wrapped so HashTable picks them up through get_hash.
+struct LegacyU32 {
+    u32 value;
+};
+
+struct LegacyBitmap {
+    Bitmap<256> bitmap;
+};
+
+struct LegacyString {
+    String string;
+};
+
+inline bool operator==(LegacyU32 lhs, LegacyU32 rhs)       { return lhs.value == rhs.value; }
+inline bool operator==(LegacyBitmap lhs, LegacyBitmap rhs) { return lhs.bitmap == rhs.bitmap; }
+inline bool operator==(LegacyString lhs, LegacyString rhs) { return lhs.string == rhs.string; }
+
+inline u64 get_hash(LegacyU32 key) {
+    return (1 + key.value) ^ 109238123;
+}
+
+inline u64 get_hash(LegacyBitmap key) {
+    u64 total = 0;
+
+    for (u32 i = 0; i < 256 / 64; i++) {
+        total += key.bitmap.bits[i];
+    }
+
+    return total;
+}
+
+inline u64 get_hash(LegacyString key) {
+    u64   hash = 5381;
+    char* str  = key.string.text;
+    s32   c;
+
+    while ((c = *str++)) {
+        hash = ((hash << 5) + hash) + c;
+    }
+
+    return hash;
+}
+
+static void key_free(String* key)       { string_free(key); }
+static void key_free(LegacyString* key) { string_free(&key->string); }
+
+static int compare_u64(const void* a, const void* b) {
+    u64 lhs = *(const u64*)a;
+    u64 rhs = *(const u64*)b;
+
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+template <typename Key>
+static void benchmark_keys(const char* name, Key* keys, u32 count) {
+    u64* hashes = (u64*)malloc(sizeof(u64) * count);
+
+    for (u32 i = 0; i < count; i++) {
+        hashes[i] = table_hash(keys[i]);
+    }
+
+    qsort(hashes, count, sizeof(u64), compare_u64);
+
+    u32 collisions = 0;
+
+    for (u32 i = 1; i < count; i++) {
+        if (hashes[i] == hashes[i - 1]) collisions++;
+    }
+
+    free(hashes);
+
+    HashTableProbeStats stats = {};
+    u64                 found = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (u32 round = 0; round < BENCHMARK_ROUNDS; round++) {
+        HashTable<Key, u32> table = table_make<Key, u32>(Allocator_Persistent, 16);
+
+        for (u32 i = 0; i < count; i++) {
+            table_add(&table, keys[i], i);
+        }
+
+        for (u32 i = 0; i < count; i++) {
+            u32 value;
+            found += table_try_get(&table, keys[i], &value);
+        }
+
+        if (round == 0) stats = table_probe_stats(&table);
+
+        table_free(&table);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double ns_per_op = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / ((double)count * 2 * BENCHMARK_ROUNDS);
+
+    printf("%-28s %8u %10u %10.3f %10u %12u %10.2f\n",
+           name, count, collisions,
+           (double)stats.groups_total / (double)stats.count, stats.groups_max,
+           stats.tag_false_positives, ns_per_op);
+
+    Assert(found == (u64)count * BENCHMARK_ROUNDS, "Lost keys in the hash table.");
+}
+
+template <typename Key>
+static void benchmark_ids(const char* name, u32 stride) {
+    Key* keys = (Key*)malloc(sizeof(Key) * BENCHMARK_KEYS_COUNT);
+
+    for (u32 i = 0; i < BENCHMARK_KEYS_COUNT; i++) {
+        keys[i] = Key { i * stride };
+    }
+
+    benchmark_keys(name, keys, BENCHMARK_KEYS_COUNT);
+
+    free(keys);
+}
+
+// Archetypes are a handful of component bits, mostly inside the first word.
+template <typename Key>
+static void benchmark_archetypes(const char* name, u32 count) {
+    Key* keys = (Key*)malloc(sizeof(Key) * count);
+
+    srand(1);
+
+    for (u32 i = 0; i < count; i++) {
+        Bitmap<256> bitmap = {};
+
+        // Every archetype is unique, the index is spread over the first 40 bits, plus some random extra components.
+        for (u32 bit = 0; bit < 20; bit++) {
+            if (i & (1u << bit)) bitmap_set_bit(bitmap, bit * 2);
+        }
+
+        bitmap_set_bit(bitmap, 40 + rand() % 24);
+
+        if (rand() % 4 == 0) bitmap_set_bit(bitmap, 64 + rand() % 64);
+
+        keys[i] = Key { bitmap };
+    }
+
+    benchmark_keys(name, keys, count);
+
+    free(keys);
+}
+
+template <typename Key>
+static void benchmark_strings(const char* name, u32 count) {
+    Key* keys = (Key*)malloc(sizeof(Key) * count);
+
+    for (u32 i = 0; i < count; i++) {
+        char buf[64];
+        sprintf(buf, "u_material_%u", i);
+
+        keys[i] = Key { String(buf) };
+    }
+
+    benchmark_keys(name, keys, count);
+
+    for (u32 i = 0; i < count; i++) {
+        key_free(&keys[i]);
+    }
+
+    free(keys);
+}
+
+int main() {
+    printf("%-28s %8s %10s %10s %10s %12s %10s\n", "keys", "count", "collisions", "avg_groups", "max_groups", "tag_misses", "ns/op");
+
+    benchmark_ids<LegacyU32>("entity id, legacy",             1);
+    benchmark_ids<u32>      ("entity id",                     1);
+    benchmark_ids<LegacyU32>("entity id stride 4096, legacy", 4096);
+    benchmark_ids<u32>      ("entity id stride 4096",         4096);
+
+    benchmark_archetypes<LegacyBitmap>("archetype, legacy", BENCHMARK_KEYS_COUNT / 10);
+    benchmark_archetypes<Bitmap<256>> ("archetype",         BENCHMARK_KEYS_COUNT / 10);
+
+    benchmark_strings<LegacyString>("string, legacy", BENCHMARK_KEYS_COUNT / 10);
+    benchmark_strings<String>      ("string",         BENCHMARK_KEYS_COUNT / 10);
+
+    return 0;
+}
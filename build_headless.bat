@@ -0,0 +1,18 @@
+@echo off
+rem Headless target: the game linked with glass_null.cpp and render_null.cpp instead of glass_sdl.cpp and render_opengl.cpp,
+rem so it needs neither SDL, glad nor a GL context. Run it with: build_headless\main --headless [--frames N] [--entities N]
+setlocal
+
+set CXX="C:/Program Files/LLVM/bin/clang++.exe"
+set FLAGS=-std=c++20 -g -DDEBUG -Iinclude -I. -fprebuilt-module-path=build_headless
+set OUT=build_headless
+
+if not exist %OUT% mkdir %OUT%
+
+rem Modules in import order.
+for %%m in (math array bitmap queue text vector2 vector3 vector4 list hash_table rlist quaternion matrix4) do (
+    %CXX% %FLAGS% --precompile include/%%m.cppm -o %OUT%/%%m.pcm || exit /b 1
+    %CXX% %FLAGS% -c %OUT%/%%m.pcm -o %OUT%/%%m.o || exit /b 1
+)
+
+%CXX% %FLAGS% -o %OUT%/main.exe basic.cpp main.cpp glass_null.cpp render_null.cpp entities.cpp components.cpp camera.cpp geometry.cpp context.cpp %OUT%/*.o || exit /b 1
@@ -4,6 +4,8 @@
 #include "assert.h"
 #include "malloc.h"
 #include <string.h>
+#include <atomic>
+#include "hash_functions.h"
 #define BITMAP_IMPLEMENTATION
 #include "components.h"
 
@@ -13,28 +15,145 @@ import bitmap;
 
 #define COMPONENTS_ADD_REALLOC_COUNT 256
 
-#define COMPONENTS_MALLOC(type, size) (type*)malloc(size)
-#define COMPONENTS_FREE(ptr) free(ptr)
-#define COMPONENTS_REALLOC(ptr, size) realloc(ptr, size)
+#ifdef COMPONENTS_CUSTOM_MALLOC
+#elif defined(MEMORY_DEBUG)
+    #define COMPONENTS_MALLOC(type, size) (type*)memory_alloc(size, MEMORY_TAG_ECS)
+    #define COMPONENTS_FREE(ptr) memory_free(ptr)
+    #define COMPONENTS_REALLOC(ptr, size) memory_realloc(ptr, size, MEMORY_TAG_ECS)
+#else
+    #define COMPONENTS_MALLOC(type, size) (type*)malloc(size)
+    #define COMPONENTS_FREE(ptr) free(ptr)
+    #define COMPONENTS_REALLOC(ptr, size) realloc(ptr, size)
+#endif
 
-#define COMPONENTS_INITIAL_SPARSE_LENGTH 1024
+#define COMPONENTS_SPARSE_PAGE_SHIFT     12
+#define COMPONENTS_SPARSE_PAGE_LENGTH    (1 << COMPONENTS_SPARSE_PAGE_SHIFT)
+#define COMPONENTS_SPARSE_PAGE_MASK      (COMPONENTS_SPARSE_PAGE_LENGTH - 1)
+#define COMPONENTS_INITIAL_SPARSE_PAGES  16
 #define COMPONENTS_INITIAL_DENSE_LENGTH  128
 
+#define ARCHETYPE_CHUNK_SIZE             (16 * 1024)
+#define ARCHETYPE_COLUMN_ALIGNMENT       16
+#define ARCHETYPE_INITIAL_CHUNKS_LENGTH  8
+
+#define COMPONENTS_TICK_BLOCK_SIZE       64 // dense rows of a sparse table sharing one max tick
+#define QUERY_MAX_CHANGED                4
+#define QUERY_MAX_SPARSE                 8
+#define QUERY_DEFRAG_CHECK_ROWS          256 // rows between two checks of the defrag time budget
+
+#define SHARED_VALUES_INITIAL_LENGTH     16
+#define SHARED_GROUP_INITIAL_LENGTH      64
+#define SHARED_VALUE_NONE                u32_max
+#define GROUP_MAX_COMPONENTS             4
+
 typedef u32 Entity;
 static Archetype Archetype_Zero = {};
 
+// Every sparse page that was never written points here, reads need no branch and the page is never written.
+inline const u32 Components_Zero_Page[COMPONENTS_SPARSE_PAGE_LENGTH] = {};
+
+enum ComponentStorage {
+    COMPONENT_STORAGE_SPARSE = 0, // sparse set inside the component table
+    COMPONENT_STORAGE_CHUNK  = 1, // column inside the archetype chunks
+    COMPONENT_STORAGE_TAG    = 2, // no data, only the archetype bit
+    COMPONENT_STORAGE_SHARED = 3, // sparse set of SharedRef rows, equal values are stored once
+};
+
 struct EntityHandle {
     u32 id;
     u32 generation;
 };
 
+struct ArchetypeColumn {
+    u32 offset;
+    u32 size;
+    u32 ticks_offset;      // per row tick of the last write
+    u32 chunk_tick_offset; // max tick of the column inside the chunk
+};
+
+// Entities of the same archetype, packed into fixed size chunks.
+// Each chunk starts with the entity column followed by one column per chunk stored component,
+// every component column is followed by its tick column. Max ticks of the columns are stored at the end of the chunk.
+// Every chunk except the last one is full, so row -> (row / chunk_capacity, row % chunk_capacity).
+// The last chunk, which empties, is kept as the spare and reused by the next push, so an entity passing through
+// the archetype does not allocate and free a chunk every time. archetype_storage_trim frees it.
+struct ArchetypeStorage {
+    Archetype          archetype;
+    List<u8*>          chunks;
+    u8*                spare;        // empty chunk, not in chunks, NULL if there is none
+    ArchetypeColumn*   columns;      // indexed by component bit, size == 0 if the component is not stored in chunks
+    ArchetypeStorage** add_edges;    // indexed by component bit, NULL until the transition is resolved
+    ArchetypeStorage** remove_edges; // indexed by component bit, NULL until the transition is resolved
+    u32*               column_bits;
+    u32                columns_count;
+    u32                chunk_capacity;
+    u32                count;
+};
+
+// Initial values for entity_create_batch, data points to count tightly packed components.
+struct ComponentSpan {
+    u32         bit;
+    const void* data;
+};
+
 struct EntitySlot {
-    u32       generation;
-    Archetype archetype;
+    u32               generation;
+    u32               row;
+    Archetype         archetype;
+    ArchetypeStorage* storage;
+};
+
+// Part of a single chunk handed to a query_par_for_each procedure, iterate it with BEGIN_ITERATE_RANGE.
+struct QueryRange {
+    ArchetypeStorage* storage;
+    u32               chunk;
+    u32               first; // row inside the chunk
+    u32               count;
+};
+
+typedef void (*QueryRangeProc)(QueryRange* range, void* data);
+
+struct QueryRangeJob {
+    QueryRange     range;
+    QueryRangeProc proc;
+    void*          data;
+};
+
+// Cursor of an incremental query_defrag pass. Rows before positions[i] of the i-th sparse table
+// already follow the query order in this pass.
+struct QueryDefrag {
+    u32  storage;
+    u32  chunk;
+    u32  row;
+    u32  positions[QUERY_MAX_SPARSE];
+    u32  swaps;  // dense rows moved in this pass
+    bool sorted; // the last finished pass did not move anything
+};
+
+// Compiled query. Matching archetypes are cached once and appended to when a new archetype appears,
+// so iterating a query never scans em->archetypes.
+// Optional components do not affect matching, use GET_COMPONENT_IF_EXIST to fetch them.
+// Changed components filter BEGIN_ITERATE_QUERY_CHANGED, a row passes if any of them was written after the given tick.
+struct Query {
+    Archetype               with;
+    Archetype               without;
+    Archetype               optional;
+    Archetype               changed;
+    u32                     changed_bits[QUERY_MAX_CHANGED];
+    u32                     changed_count;
+    u32                     sparse_bits[QUERY_MAX_SPARSE]; // with and optional components stored in component tables
+    u32                     sparse_count;
+    QueryDefrag             defrag;
+    List<ArchetypeStorage*> archetypes;
+    List<QueryRangeJob>     range_jobs; // reused by every query_par_for_each, so a query runs one of them at a time
 };
 
 struct EntityManager {
-    HashTable<Archetype, List<Entity>> archetypes;
+    HashTable<Archetype, ArchetypeStorage*> archetypes;
+    List<Query*>                            queries;
+    ArchetypeStorage**                      root_edges; // add edges of the empty archetype
+    u32                                     tick;       // change tick written by every component write, advanced once per frame
+    u32                                     structure_version; // bumped whenever archetype rows move, caches of row pointers compare it
     EntitySlot* entities;
     u32*        free;
     u32         entities_count;
@@ -42,55 +161,341 @@ struct EntityManager {
     u32         free_count;
 };
 
+enum EntityCommandType {
+    ENTITY_COMMAND_DESTROY = 0,
+    ENTITY_COMMAND_ADD     = 1,
+    ENTITY_COMMAND_REMOVE  = 2,
+    ENTITY_COMMAND_SET     = 3,
+};
+
+struct EntityCommand {
+    EntityCommandType type;
+    u32               bit;
+    u32               data_offset; // offset of the component value in EntityCommandBuffer::data
+    EntityHandle      entity;
+};
+
+// Structural changes recorded during iteration and applied at a sync point with ecb_playback.
+// Buffers live in the given allocator, with Allocator_Temp the buffer has to be played back before the frame ends.
+struct EntityCommandBuffer {
+    EntityManager*      em;
+    List<EntityCommand> commands;
+    List<u8>            data;
+};
+
+// Dense row of a shared component table.
+struct SharedRef {
+    u32 value;  // index into SharedValues
+    u32 member; // index of the entity in SharedValues::entities[value]
+};
+
+// Interned values of a shared component. Values are compared byte by byte, so padding has to be zeroed.
+// Every value keeps the list of its entities, so they can be processed group by group without sorting.
+// Arrays are made on the first value, tables are created before the persistent allocator exists.
+struct SharedValues {
+    u8*                 values;
+    u8*                 zero;       // zero initialized value for adds without data
+    u32*                refcounts;  // 0 marks a free slot
+    List<Entity>*       entities;
+    u32*                free;
+    HashTable<u64, u32> by_hash;    // hash of the value bytes to the value index
+    u32                 value_size;
+    u32                 count;      // used slots, free ones included
+    u32                 length;
+    u32                 free_count;
+};
+
+struct Group;
+
 struct ComponentTable {
-    void* dense;
-    u32*  sparse;
-    u32*  entity_by_component_id;
-    u32   dense_count;
-    u32   dense_length;
-    u32   sparse_length;
-    u32   component_size;
+    void*            dense;
+    u32**            sparse_pages;           // COMPONENTS_SPARSE_PAGE_LENGTH dense ids per page, Components_Zero_Page until written
+    u32*             sparse_page_counts;     // live entries per page, an emptied page is kept until component_table_trim
+    u32*             entity_by_component_id;
+    u32*             ticks;                  // per dense row tick of the last write
+    u32*             block_ticks;            // max tick of every COMPONENTS_TICK_BLOCK_SIZE dense rows
+    u32              dense_count;
+    u32              dense_length;
+    u32              sparse_pages_length;
+    u32              component_size;         // size of a dense row, sizeof(SharedRef) for shared components
+    ComponentStorage storage;
+    SharedValues*    shared;                 // only for COMPONENT_STORAGE_SHARED
+    Group*           group;                  // owning group, dense rows 1..group->count belong to it
+};
+
+// Owning group over sparse tables. Entities, which have every component of the group, take dense rows
+// 1..count of every owned table in the same order, so the group is walked as parallel arrays without sparse lookups.
+// Adds and removes swap rows to keep the group packed at the front of the tables.
+// A table is owned by at most one group and query_defrag leaves owned tables alone.
+struct Group {
+    ComponentTable* tables[GROUP_MAX_COMPONENTS];
+    u32             tables_count;
+    u32             count;
 };
 
 
 void         entity_manager_make(EntityManager* em);
+u32          entity_manager_advance_tick(EntityManager* em);
+void         entity_manager_trim(EntityManager* em);
 
 EntityHandle entity_create(EntityManager* em);
 bool         entity_is_alive(EntityManager* em, EntityHandle handle);
 void         entity_destroy(EntityManager* em, EntityHandle handle);
+void         entity_create_batch(EntityManager* em, u32 count, Archetype archetype, EntityHandle* out_handles, ComponentSpan* spans = NULL, u32 spans_count = 0);
+void         entity_destroy_batch(EntityManager* em, EntityHandle* handles, u32 count);
 Archetype&   entity_get_archetype(EntityManager* em, Entity entity);
+void         entity_mark_changed(EntityManager* em, Entity entity, u32 bit);
 
 void         archetype_remove(EntityManager* em, Entity entity);
 void         archetype_add(EntityManager* em, Entity entity);
+void         archetype_move(EntityManager* em, Entity entity, Archetype archetype);
+void         archetype_move_to(EntityManager* em, Entity entity, ArchetypeStorage* storage);
+
+ArchetypeStorage* archetype_storage_make(Archetype archetype);
+void              archetype_storage_free(ArchetypeStorage* storage);
+ArchetypeStorage* archetype_storage_get_or_make(EntityManager* em, Archetype archetype);
+ArchetypeStorage* archetype_storage_add_edge(EntityManager* em, ArchetypeStorage* from, u32 bit);
+ArchetypeStorage* archetype_storage_remove_edge(EntityManager* em, ArchetypeStorage* from, u32 bit);
+u32               archetype_storage_push(ArchetypeStorage* storage, Entity entity, u32 tick);
+u32               archetype_storage_push_batch(ArchetypeStorage* storage, Entity* entities, u32 count, u32 tick);
+void              archetype_storage_set_rows(ArchetypeStorage* storage, u32 first, u32 count, u32 bit, const void* data, u32 tick);
+void              archetype_storage_remove(EntityManager* em, ArchetypeStorage* storage, u32 row);
+void              archetype_storage_trim(ArchetypeStorage* storage);
+
+void*        entity_add_component(EntityManager* em, Entity entity, u32 bit, const void* component);
+void         entity_set_shared(EntityManager* em, Entity entity, u32 bit, const void* value);
+void         entity_remove_component(EntityManager* em, Entity entity, u32 bit);
 
-static inline ComponentTable component_table_make(u32 component_size);
+void         ecb_make(EntityCommandBuffer* ecb, EntityManager* em, Allocator* allocator = Allocator_Temp);
+void         ecb_free(EntityCommandBuffer* ecb);
+EntityHandle ecb_create(EntityCommandBuffer* ecb);
+void         ecb_destroy(EntityCommandBuffer* ecb, EntityHandle entity);
+void         ecb_add(EntityCommandBuffer* ecb, EntityHandle entity, u32 bit, const void* component);
+void         ecb_remove(EntityCommandBuffer* ecb, EntityHandle entity, u32 bit);
+void         ecb_set(EntityCommandBuffer* ecb, EntityHandle entity, u32 bit, const void* component);
+void         ecb_playback(EntityCommandBuffer* ecb);
+
+void         group_make(Group* group, Archetype components);
+void         group_free(Group* group);
+
+void         query_make(EntityManager* em, Query* query, Archetype with, Archetype without = Archetype_Zero, Archetype optional = Archetype_Zero, Archetype changed = Archetype_Zero);
+void         query_free(EntityManager* em, Query* query);
+void         query_par_for_each(Query* query, u32 grain, QueryRangeProc proc, void* data);
+bool         query_defrag(Query* query, u64 budget_us);
+static inline bool query_matches(Query* query, Archetype archetype);
+static inline bool query_chunk_changed(Query* query, ArchetypeStorage* storage, u32 chunk, u32 since);
+static inline bool query_row_changed(Query* query, ArchetypeStorage* storage, u32 chunk, u32 index, Entity entity, u32 since);
+
+static inline u8*     archetype_storage_chunk(ArchetypeStorage* storage, u32 chunk);
+static inline u32     archetype_storage_chunk_count(ArchetypeStorage* storage, u32 chunk);
+static inline Entity* archetype_storage_entities(ArchetypeStorage* storage, u32 chunk);
+static inline void*   archetype_storage_column(ArchetypeStorage* storage, u32 chunk, u32 bit);
+static inline void*   archetype_storage_get(ArchetypeStorage* storage, u32 row, u32 bit);
+static inline u32*    archetype_storage_ticks(ArchetypeStorage* storage, u32 chunk, u32 bit);
+static inline u32*    archetype_storage_chunk_tick(ArchetypeStorage* storage, u32 chunk, u32 bit);
+static inline void    archetype_storage_mark_changed(ArchetypeStorage* storage, u32 row, u32 bit, u32 tick);
+static inline void    archetype_storage_mark_changed_at(ArchetypeStorage* storage, u32 chunk, u32 index, u32 bit, u32 tick);
+
+static inline ComponentTable component_table_make(u32 component_size, ComponentStorage storage = COMPONENT_STORAGE_SPARSE);
 static inline void           component_table_free(ComponentTable* table);
-static inline void           component_table_realloc_sparse(ComponentTable* table, u32 size);
+static inline void           component_table_reserve_sparse(ComponentTable* table, Entity entity);
+static inline u32            component_table_sparse_get(ComponentTable* table, Entity entity);
+static inline void           component_table_sparse_set(ComponentTable* table, Entity entity, u32 id);
+static inline void           component_table_trim(ComponentTable* table);
 static inline void           component_table_realloc_dense(ComponentTable* table, u32 size);
+static inline void           component_table_reserve_dense(ComponentTable* table, u32 length);
 static inline bool           component_table_has(ComponentTable* table, Entity entity);
 static inline void           component_table_remove(ComponentTable* table, Entity entity);
+static inline void           component_table_swap_rows(ComponentTable* table, u32 a, u32 b);
+static inline void*          component_table_add_raw(ComponentTable* table, Entity entity, const void* component, u32 tick);
+static inline void*          component_table_get_raw(ComponentTable* table, Entity entity);
+static inline void           component_table_add_batch(ComponentTable* table, const Entity* entities, u32 count, const void* components, u32 tick);
+static inline void           component_table_mark_changed(ComponentTable* table, Entity entity, u32 tick);
+static inline bool           component_table_changed_since(ComponentTable* table, u32 since);
+static inline bool           component_table_is_sparse(ComponentTable* table);
+static inline u32            component_table_value_size(ComponentTable* table);
+static inline void*          component_table_add_shared(ComponentTable* table, Entity entity, const void* value, u32 tick);
+static inline void           component_table_add_shared_batch(ComponentTable* table, const Entity* entities, u32 count, const void* values, u32 tick);
+static inline void           component_table_set_shared(ComponentTable* table, Entity entity, const void* value, u32 tick);
+static inline void*          component_table_get_shared(ComponentTable* table, Entity entity);
+static inline void           component_table_detach_shared(ComponentTable* table, Entity entity);
+
+static inline bool           group_contains(Group* group, Entity entity);
+static inline void           group_try_add(Group* group, Entity entity);
+static inline void           group_try_remove(Group* group, Entity entity);
+
+static inline SharedValues*  shared_values_make(u32 value_size);
+static inline void           shared_values_free(SharedValues* shared);
+static inline void*          shared_values_get(SharedValues* shared, u32 index);
+static inline u32            shared_values_acquire(SharedValues* shared, const void* value);
+static inline void           shared_values_release(SharedValues* shared, u32 index);
+static inline u32            component_table_tick(ComponentTable* table, Entity entity);
 
 template <typename T>
-static inline T*   component_table_add(ComponentTable* table, Entity entity, T component);
+static inline T*   component_table_add(ComponentTable* table, Entity entity, T component, u32 tick);
 template <typename T>
 static inline T*   component_table_get(ComponentTable* table, Entity entity);
 template <typename T>
-static inline void component_table_set(ComponentTable* table, Entity handle, T component);
+static inline void component_table_set(ComponentTable* table, Entity handle, T component, u32 tick);
+
+template <typename T>
+static inline T*   entity_add_component(EntityManager* em, Entity entity, u32 bit, T component);
+template <typename T>
+static inline T*   entity_get_component(EntityManager* em, ComponentTable* table, u32 bit, Entity entity);
+template <typename T>
+static inline T*   entity_get_component_mut(EntityManager* em, ComponentTable* table, u32 bit, Entity entity);
+
+static inline bool query_matches(Query* query, Archetype archetype) {
+    return bitmap_contains(archetype, query->with) && bitmap_intersects(archetype, query->without) == false;
+}
+
+// Chunk stored components are tested by the max tick of the chunk, sparse ones can only be decided per row.
+static inline bool query_chunk_changed(Query* query, ArchetypeStorage* storage, u32 chunk, u32 since) {
+    for (u32 i = 0; i < query->changed_count; i++) {
+        u32 bit = query->changed_bits[i];
+
+        if (storage->columns[bit].size == 0)                       return true;
+        if (*archetype_storage_chunk_tick(storage, chunk, bit) > since) return true;
+    }
+
+    return false;
+}
+
+static inline bool query_row_changed(Query* query, ArchetypeStorage* storage, u32 chunk, u32 index, Entity entity, u32 since) {
+    for (u32 i = 0; i < query->changed_count; i++) {
+        u32 bit = query->changed_bits[i];
+        u32 tick;
+
+        if (storage->columns[bit].size != 0) {
+            tick = archetype_storage_ticks(storage, chunk, bit)[index];
+        } else {
+            ComponentTable* table = get_component_table_by_bit(bit);
+
+            // Optional changed component, which the entity does not have.
+            if (component_table_has(table, entity) == false) continue;
+
+            tick = component_table_tick(table, entity);
+        }
+
+        if (tick > since) return true;
+    }
+
+    return false;
+}
+
+static inline u8* archetype_storage_chunk(ArchetypeStorage* storage, u32 chunk) {
+    return storage->chunks.data[chunk];
+}
+
+static inline u32 archetype_storage_chunk_count(ArchetypeStorage* storage, u32 chunk) {
+    u32 first = chunk * storage->chunk_capacity;
+    u32 left  = storage->count - first;
+
+    return left < storage->chunk_capacity ? left : storage->chunk_capacity;
+}
+
+static inline Entity* archetype_storage_entities(ArchetypeStorage* storage, u32 chunk) {
+    return (Entity*)archetype_storage_chunk(storage, chunk);
+}
+
+static inline void* archetype_storage_column(ArchetypeStorage* storage, u32 chunk, u32 bit) {
+    ArchetypeColumn column = storage->columns[bit];
+
+    if (column.size == 0) return NULL;
 
+    return archetype_storage_chunk(storage, chunk) + column.offset;
+}
+
+static inline void* archetype_storage_get(ArchetypeStorage* storage, u32 row, u32 bit) {
+    ArchetypeColumn column = storage->columns[bit];
+    Assertf(column.size != 0, "Component with bit %d is not stored in the archetype chunks.", bit);
+
+    u32 chunk = row / storage->chunk_capacity;
+    u32 index = row % storage->chunk_capacity;
+
+    return archetype_storage_chunk(storage, chunk) + column.offset + index * column.size;
+}
+
+static inline u32* archetype_storage_ticks(ArchetypeStorage* storage, u32 chunk, u32 bit) {
+    ArchetypeColumn column = storage->columns[bit];
+
+    if (column.size == 0) return NULL;
+
+    return (u32*)(archetype_storage_chunk(storage, chunk) + column.ticks_offset);
+}
+
+static inline u32* archetype_storage_chunk_tick(ArchetypeStorage* storage, u32 chunk, u32 bit) {
+    return (u32*)(archetype_storage_chunk(storage, chunk) + storage->columns[bit].chunk_tick_offset);
+}
+
+// Max ticks cover many rows, which query_par_for_each can hand to different jobs, so they are raised
+// with a relaxed atomic fetch-max. Row ticks belong to a single job and stay plain stores.
+static inline void components_tick_max(u32* max_tick, u32 tick) {
+    std::atomic_ref<u32> max(*max_tick);
+    u32                  current = max.load(std::memory_order_relaxed);
+
+    while (current < tick && max.compare_exchange_weak(current, tick, std::memory_order_relaxed) == false) {}
+}
+
+static inline void archetype_storage_mark_changed_at(ArchetypeStorage* storage, u32 chunk, u32 index, u32 bit, u32 tick) {
+    Assertf(storage->columns[bit].size != 0, "Component with bit %d is not stored in the archetype chunks.", bit);
+
+    u32* chunk_tick = archetype_storage_chunk_tick(storage, chunk, bit);
+
+    archetype_storage_ticks(storage, chunk, bit)[index] = tick;
+
+    components_tick_max(chunk_tick, tick);
+}
+
+static inline void archetype_storage_mark_changed(ArchetypeStorage* storage, u32 row, u32 bit, u32 tick) {
+    archetype_storage_mark_changed_at(storage, row / storage->chunk_capacity, row % storage->chunk_capacity, bit, tick);
+}
+
+static inline ComponentTable component_table_make(u32 component_size, ComponentStorage storage) {
+    if (storage == COMPONENT_STORAGE_SHARED) {
+        // Rows only point at the interned value.
+        ComponentTable table = component_table_make(sizeof(SharedRef), COMPONENT_STORAGE_SPARSE);
+
+        table.storage = storage;
+        table.shared  = shared_values_make(component_size);
+
+        return table;
+    }
+
+    if (storage != COMPONENT_STORAGE_SPARSE) {
+        // Data lives in the archetype chunks or nowhere for tags, the table only describes the component.
+        ComponentTable table = {};
+
+        table.component_size = component_size;
+        table.storage        = storage;
+
+        return table;
+    }
 
-static inline ComponentTable component_table_make(u32 component_size) {
     ComponentTable table = {
         .dense                  = COMPONENTS_MALLOC(void, component_size * COMPONENTS_INITIAL_DENSE_LENGTH),
-        .sparse                 = COMPONENTS_MALLOC(u32, sizeof(u32) * COMPONENTS_INITIAL_SPARSE_LENGTH),
+        .sparse_pages           = COMPONENTS_MALLOC(u32*, sizeof(u32*) * COMPONENTS_INITIAL_SPARSE_PAGES),
+        .sparse_page_counts     = COMPONENTS_MALLOC(u32, sizeof(u32) * COMPONENTS_INITIAL_SPARSE_PAGES),
         .entity_by_component_id = COMPONENTS_MALLOC(u32, sizeof(u32) * COMPONENTS_INITIAL_DENSE_LENGTH),
+        .ticks                  = COMPONENTS_MALLOC(u32, sizeof(u32) * COMPONENTS_INITIAL_DENSE_LENGTH),
+        .block_ticks            = COMPONENTS_MALLOC(u32, sizeof(u32) * (COMPONENTS_INITIAL_DENSE_LENGTH / COMPONENTS_TICK_BLOCK_SIZE + 1)),
         .dense_count            = 1,
         .dense_length           = COMPONENTS_INITIAL_DENSE_LENGTH,
-        .sparse_length          = COMPONENTS_INITIAL_SPARSE_LENGTH,
+        .sparse_pages_length    = COMPONENTS_INITIAL_SPARSE_PAGES,
         .component_size         = component_size,
+        .storage                = storage,
+        .shared                 = NULL,
+        .group                  = NULL,
     };
 
-    memset(table.sparse, 0, sizeof(u32) * COMPONENTS_INITIAL_SPARSE_LENGTH);
+    for (u32 i = 0; i < COMPONENTS_INITIAL_SPARSE_PAGES; i++) {
+        table.sparse_pages[i] = (u32*)Components_Zero_Page;
+    }
+
+    memset(table.sparse_page_counts, 0, sizeof(u32) * COMPONENTS_INITIAL_SPARSE_PAGES);
     memset(table.entity_by_component_id, 0, sizeof(u32) * COMPONENTS_INITIAL_DENSE_LENGTH);
+    memset(table.ticks, 0, sizeof(u32) * COMPONENTS_INITIAL_DENSE_LENGTH);
+    memset(table.block_ticks, 0, sizeof(u32) * (COMPONENTS_INITIAL_DENSE_LENGTH / COMPONENTS_TICK_BLOCK_SIZE + 1));
 
     return table;
 }
@@ -99,82 +504,280 @@ static inline void component_table_free(ComponentTable* table) {
     Assert(table, "Cannot free NULL component table.");
 
     COMPONENTS_FREE(table->dense);
-    COMPONENTS_FREE(table->sparse);
+
+    for (u32 i = 0; i < table->sparse_pages_length; i++) {
+        if (table->sparse_pages[i] != Components_Zero_Page) COMPONENTS_FREE(table->sparse_pages[i]);
+    }
+
+    COMPONENTS_FREE(table->sparse_pages);
+    COMPONENTS_FREE(table->sparse_page_counts);
+
+    if (table->shared) shared_values_free(table->shared);
     COMPONENTS_FREE(table->entity_by_component_id);
+    COMPONENTS_FREE(table->ticks);
+    COMPONENTS_FREE(table->block_ticks);
 }
 
-static inline void component_table_realloc_sparse(ComponentTable* table, u32 size) {
+// Grows only the page directory, existing pages never move.
+static inline void component_table_reserve_sparse(ComponentTable* table, Entity entity) {
     Assert(table, "Cannot realloc NULL component table.");
+    u32 page = entity >> COMPONENTS_SPARSE_PAGE_SHIFT;
+
+    if (page < table->sparse_pages_length) return;
+
+    u32 size = table->sparse_pages_length * 2;
+    if (size <= page) size = page + 1;
+
+    table->sparse_pages       = (u32**)COMPONENTS_REALLOC(table->sparse_pages, sizeof(u32*) * size);
+    table->sparse_page_counts = (u32*)COMPONENTS_REALLOC(table->sparse_page_counts, sizeof(u32) * size);
+
+    Assert(table->sparse_pages && table->sparse_page_counts, "Cannot reallocate sparse pages for component table");
+
+    for (u32 i = table->sparse_pages_length; i < size; i++) {
+        table->sparse_pages[i] = (u32*)Components_Zero_Page;
+    }
+
+    memset(table->sparse_page_counts + table->sparse_pages_length, 0, sizeof(u32) * (size - table->sparse_pages_length));
+
+    table->sparse_pages_length = size;
+}
+
+// Dense id of the entity or 0 when it does not have the component.
+static inline u32 component_table_sparse_get(ComponentTable* table, Entity entity) {
+    u32 page = entity >> COMPONENTS_SPARSE_PAGE_SHIFT;
+    if (page >= table->sparse_pages_length) return 0;
+
+    return table->sparse_pages[page][entity & COMPONENTS_SPARSE_PAGE_MASK];
+}
+
+// Allocates the page on the first write. A page, whose last entry is cleared, stays allocated, so entities
+// churning around a page boundary do not allocate and free it every time. component_table_trim releases it.
+static inline void component_table_sparse_set(ComponentTable* table, Entity entity, u32 id) {
+    component_table_reserve_sparse(table, entity);
+
+    u32  page  = entity >> COMPONENTS_SPARSE_PAGE_SHIFT;
+    u32* slots = table->sparse_pages[page];
+    u32* count = &table->sparse_page_counts[page];
+
+    if (slots == Components_Zero_Page) {
+        if (id == 0) return;
 
-    table->sparse = (u32*)COMPONENTS_REALLOC(table->sparse, sizeof(u32) * size);
+        slots = COMPONENTS_MALLOC(u32, sizeof(u32) * COMPONENTS_SPARSE_PAGE_LENGTH);
+        Assert(slots, "Cannot allocate sparse page for component table");
+        memset(slots, 0, sizeof(u32) * COMPONENTS_SPARSE_PAGE_LENGTH);
 
-    Assert(table->sparse, "Cannot reallocate sparse data for component table");
+        table->sparse_pages[page] = slots;
+    }
+
+    u32* slot = &slots[entity & COMPONENTS_SPARSE_PAGE_MASK];
+
+    if (*slot == 0 && id != 0) (*count)++;
+    if (*slot != 0 && id == 0) (*count)--;
+
+    *slot = id;
+}
 
-    table->sparse_length = size;
+// Returns the emptied sparse pages to the zero page.
+static inline void component_table_trim(ComponentTable* table) {
+    Assert(table, "Cannot trim NULL component table.");
+
+    for (u32 i = 0; i < table->sparse_pages_length; i++) {
+        if (table->sparse_pages[i] == Components_Zero_Page || table->sparse_page_counts[i] != 0) continue;
+
+        COMPONENTS_FREE(table->sparse_pages[i]);
+        table->sparse_pages[i] = (u32*)Components_Zero_Page;
+    }
 }
 
 static inline void component_table_realloc_dense(ComponentTable* table, u32 size) {
     Assert(table, "Cannot realloc NULL component table.");
+    u32 blocks     = table->dense_length / COMPONENTS_TICK_BLOCK_SIZE + 1;
+    u32 new_blocks = size / COMPONENTS_TICK_BLOCK_SIZE + 1;
+
     table->dense                  = COMPONENTS_REALLOC(table->dense, table->component_size * size);
     table->entity_by_component_id = (u32*)COMPONENTS_REALLOC(table->entity_by_component_id, sizeof(u32) * size);
+    table->ticks                  = (u32*)COMPONENTS_REALLOC(table->ticks, sizeof(u32) * size);
+    table->block_ticks            = (u32*)COMPONENTS_REALLOC(table->block_ticks, sizeof(u32) * new_blocks);
 
     Assert(table->dense, "Cannot reallocate dense data for component table");
     Assert(table->entity_by_component_id, "Cannot reallocate entity data for component table");
+    Assert(table->ticks && table->block_ticks, "Cannot reallocate tick data for component table");
+
+    if (new_blocks > blocks) {
+        memset(table->block_ticks + blocks, 0, sizeof(u32) * (new_blocks - blocks));
+    }
 
     table->dense_length = size;
 }
 
+// Grows the dense arrays at least twice, so appending rows one by one reallocates a logarithmic number of times.
+static inline void component_table_reserve_dense(ComponentTable* table, u32 length) {
+    if (length <= table->dense_length) return;
+
+    u32 size = table->dense_length * 2;
+
+    if (size < table->dense_length + COMPONENTS_ADD_REALLOC_COUNT) size = table->dense_length + COMPONENTS_ADD_REALLOC_COUNT;
+    if (size < length)                                             size = length;
+
+    component_table_realloc_dense(table, size);
+}
+
+static inline void component_table_mark_row(ComponentTable* table, u32 index, u32 tick) {
+    u32* block_tick = &table->block_ticks[index / COMPONENTS_TICK_BLOCK_SIZE];
+
+    table->ticks[index] = tick;
+
+    components_tick_max(block_tick, tick);
+}
+
+static inline void component_table_mark_changed(ComponentTable* table, Entity entity, u32 tick) {
+    Assertf(component_table_has(table, entity), "Entity (%d) you want to mark does not have the component.", entity);
+    component_table_mark_row(table, component_table_sparse_get(table, entity), tick);
+}
+
+// Any row written after the since tick, tests only the block max ticks.
+static inline bool component_table_changed_since(ComponentTable* table, u32 since) {
+    if (table->dense_count <= 1) return false;
+
+    u32 blocks = (table->dense_count - 1) / COMPONENTS_TICK_BLOCK_SIZE + 1;
+
+    for (u32 i = 0; i < blocks; i++) {
+        if (table->block_ticks[i] > since) return true;
+    }
+
+    return false;
+}
+
+static inline u32 component_table_tick(ComponentTable* table, Entity entity) {
+    Assertf(component_table_has(table, entity), "Entity (%d) does not have the component.", entity);
+    return table->ticks[component_table_sparse_get(table, entity)];
+}
+
 template <typename T>
-static inline T* component_table_add(ComponentTable* table, Entity entity, T component) {
+static inline T* component_table_add(ComponentTable* table, Entity entity, T component, u32 tick) {
     Assert(entity != 0, "Cannot use zero entity.");
     u32 id        = table->dense_count;
 
-    if (id >= table->dense_length) {
-        component_table_realloc_dense(table, id + COMPONENTS_ADD_REALLOC_COUNT);
-    }
+    component_table_reserve_dense(table, id + 1);
 
     T* dense = (T*)table->dense;
 
     dense[id] = component;
 
-    if (entity >= table->sparse_length) {
-        component_table_realloc_sparse(table, entity + COMPONENTS_ADD_REALLOC_COUNT);
+    component_table_sparse_set(table, entity, id);
+
+    table->entity_by_component_id[id] = entity;
+
+    component_table_mark_row(table, id, tick);
+
+    table->dense_count++;
+
+    if (table->group) {
+        group_try_add(table->group, entity);
+        return &dense[component_table_sparse_get(table, entity)];
     }
 
-    table->sparse[entity] = id;
+    return &dense[id];
+}
+
+static inline void* component_table_add_raw(ComponentTable* table, Entity entity, const void* component, u32 tick) {
+    Assert(entity != 0, "Cannot use zero entity.");
+    u32 id        = table->dense_count;
+
+    component_table_reserve_dense(table, id + 1);
+
+    void* dense = (char*)table->dense + id * table->component_size;
+
+    memcpy(dense, component, table->component_size);
+
+    component_table_sparse_set(table, entity, id);
 
     table->entity_by_component_id[id] = entity;
 
+    component_table_mark_row(table, id, tick);
+
     table->dense_count++;
 
-    return &dense[id];
+    if (table->group) {
+        group_try_add(table->group, entity);
+        return component_table_get_raw(table, entity);
+    }
+
+    return dense;
+}
+
+static inline void* component_table_get_raw(ComponentTable* table, Entity entity) {
+    Assertf(component_table_has(table, entity), "Entity (%d) you want to get does not have the component.", entity);
+    return (char*)table->dense + component_table_sparse_get(table, entity) * table->component_size;
+}
+
+// components points to count tightly packed values or is NULL to zero initialize them.
+static inline void component_table_add_batch(ComponentTable* table, const Entity* entities, u32 count, const void* components, u32 tick) {
+    u32 first       = table->dense_count;
+    u32 last_entity = 0;
+
+    for (u32 i = 0; i < count; i++) {
+        Assert(entities[i] != 0, "Cannot use zero entity.");
+        if (entities[i] > last_entity) last_entity = entities[i];
+    }
+
+    component_table_reserve_dense(table, first + count);
+
+    component_table_reserve_sparse(table, last_entity);
+
+    char* dense = (char*)table->dense + first * table->component_size;
+
+    if (components) {
+        memcpy(dense, components, table->component_size * count);
+    } else {
+        memset(dense, 0, table->component_size * count);
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        component_table_sparse_set(table, entities[i], first + i);
+        table->entity_by_component_id[first + i] = entities[i];
+        component_table_mark_row(table, first + i, tick);
+    }
+
+    table->dense_count += count;
+
+    if (table->group) {
+        for (u32 i = 0; i < count; i++) {
+            group_try_add(table->group, entities[i]);
+        }
+    }
 }
 
 template <typename T>
 static inline T* component_table_get(ComponentTable* table, Entity entity) {
     Assertf(component_table_has(table, entity), "Entity (%d) you want to get does not have the component.", entity);
+    if (table->storage == COMPONENT_STORAGE_SHARED) return (T*)component_table_get_shared(table, entity);
+
     T* dense = (T*)table->dense;
-    return &dense[table->sparse[entity]];
+    return &dense[component_table_sparse_get(table, entity)];
 }
 
 static inline bool component_table_has(ComponentTable* table, Entity entity) {
     Assert(entity != 0, "Cannot use zero entity.");
-    if (table->sparse_length <= entity) return false;
-
-    return table->sparse[entity] != 0;
+    return component_table_sparse_get(table, entity) != 0;
 }
 
 template <typename T>
-static inline void component_table_set(ComponentTable* table, Entity entity, T component) {
+static inline void component_table_set(ComponentTable* table, Entity entity, T component, u32 tick) {
     Assert(entity != 0, "Cannot use zero entity.");
     Assertf(component_table_has(table, entity), "Cannot set component. Entity does not have the component attached.");
-    T* dense = (T*)table->dense;
-    dense[table->sparse[entity]] = component;
+    T*  dense = (T*)table->dense;
+    u32 id    = component_table_sparse_get(table, entity);
+    dense[id] = component;
+    component_table_mark_row(table, id, tick);
 }
 
 static inline void component_table_remove(ComponentTable* table, Entity entity) {
     Assertf(component_table_has(table, entity), "Entity (%d) you want to remove does not have the component.", entity);
-    u32 index       = table->sparse[entity];
+    if (table->storage == COMPONENT_STORAGE_SHARED) component_table_detach_shared(table, entity);
+    if (table->group) group_try_remove(table->group, entity);
+
+    u32 index       = component_table_sparse_get(table, entity);
     u32 last        = table->dense_count - 1;
     u32 last_entity = table->entity_by_component_id[last];
 
@@ -188,22 +791,343 @@ static inline void component_table_remove(ComponentTable* table, Entity entity)
 
     table->entity_by_component_id[index] = last_entity;
     table->entity_by_component_id[last]  = 0;
-    table->sparse[entity]                = 0;
-    table->sparse[last_entity]           = index;
+
+    // Clear the removed entity last, when it is the last row both are the same entity.
+    component_table_sparse_set(table, last_entity, index);
+    component_table_sparse_set(table, entity, 0);
+
+    component_table_mark_row(table, index, table->ticks[last]);
+    table->ticks[last] = 0;
 
     table->dense_count--;
 }
 
+static inline SharedValues* shared_values_make(u32 value_size) {
+    SharedValues* shared = COMPONENTS_MALLOC(SharedValues, sizeof(SharedValues));
+    Assert(shared, "Cannot allocate shared values");
+
+    *shared = {};
+
+    shared->value_size = value_size;
+    shared->zero       = COMPONENTS_MALLOC(u8, value_size);
+    Assert(shared->zero, "Cannot allocate shared values");
+
+    memset(shared->zero, 0, value_size);
+
+    return shared;
+}
+
+static inline void shared_values_free(SharedValues* shared) {
+    Assert(shared, "Cannot free NULL shared values.");
+
+    for (u32 i = 0; i < shared->count; i++) {
+        if (shared->refcounts[i] > 0) list_free(&shared->entities[i]);
+    }
+
+    if (shared->by_hash.data) table_free(&shared->by_hash);
+
+    COMPONENTS_FREE(shared->values);
+    COMPONENTS_FREE(shared->zero);
+    COMPONENTS_FREE(shared->refcounts);
+    COMPONENTS_FREE(shared->entities);
+    COMPONENTS_FREE(shared->free);
+    COMPONENTS_FREE(shared);
+}
+
+static inline void* shared_values_get(SharedValues* shared, u32 index) {
+    return shared->values + index * shared->value_size;
+}
+
+static inline u32 shared_values_find(SharedValues* shared, const void* value, u64 hash) {
+    u32 index;
+
+    if (table_try_get(&shared->by_hash, hash, &index) == false) return SHARED_VALUE_NONE;
+    if (memcmp(shared_values_get(shared, index), value, shared->value_size) == 0) return index;
+
+    // Two different values with the same hash, only the first one is in the table.
+    for (u32 i = 0; i < shared->count; i++) {
+        if (shared->refcounts[i] == 0) continue;
+        if (memcmp(shared_values_get(shared, i), value, shared->value_size) == 0) return i;
+    }
+
+    return SHARED_VALUE_NONE;
+}
+
+static inline void shared_values_realloc(SharedValues* shared, u32 length) {
+    shared->values    = (u8*)COMPONENTS_REALLOC(shared->values, shared->value_size * length);
+    shared->refcounts = (u32*)COMPONENTS_REALLOC(shared->refcounts, sizeof(u32) * length);
+    shared->entities  = (List<Entity>*)COMPONENTS_REALLOC(shared->entities, sizeof(List<Entity>) * length);
+    shared->free      = (u32*)COMPONENTS_REALLOC(shared->free, sizeof(u32) * length);
+
+    Assert(shared->values && shared->refcounts && shared->entities && shared->free, "Cannot reallocate shared values");
+
+    shared->length = length;
+}
+
+// Index of the interned value, the value is added if it is not there yet. Every acquire needs a release.
+// value can be NULL for a zero initialized one.
+static inline u32 shared_values_acquire(SharedValues* shared, const void* value) {
+    if (value == NULL) value = shared->zero;
+
+    if (shared->by_hash.data == NULL) table_make(&shared->by_hash);
+
+    u64 hash  = hash_bytes(value, shared->value_size);
+    u32 index = shared_values_find(shared, value, hash);
+
+    if (index != SHARED_VALUE_NONE) {
+        shared->refcounts[index]++;
+        return index;
+    }
+
+    if (shared->free_count > 0) {
+        index = shared->free[--shared->free_count];
+    } else {
+        if (shared->count == shared->length) {
+            shared_values_realloc(shared, shared->length ? shared->length * 2 : SHARED_VALUES_INITIAL_LENGTH);
+        }
+
+        index = shared->count++;
+    }
+
+    memcpy(shared_values_get(shared, index), value, shared->value_size);
+    shared->refcounts[index] = 1;
+    shared->entities[index]  = list_make<Entity>(SHARED_GROUP_INITIAL_LENGTH);
+
+    if (table_contains(&shared->by_hash, hash) == false) table_add(&shared->by_hash, hash, index);
+
+    return index;
+}
+
+static inline void shared_values_release(SharedValues* shared, u32 index) {
+    Assertf(index < shared->count && shared->refcounts[index] > 0, "Shared value (%d) is not used.", index);
+
+    if (--shared->refcounts[index] > 0) return;
+
+    u64 hash = hash_bytes(shared_values_get(shared, index), shared->value_size);
+    u32 mapped;
+
+    if (table_try_get(&shared->by_hash, hash, &mapped) && mapped == index) table_remove(&shared->by_hash, hash);
+
+    list_free(&shared->entities[index]);
+    shared->free[shared->free_count++] = index;
+}
+
+static inline bool component_table_is_sparse(ComponentTable* table) {
+    return table->storage == COMPONENT_STORAGE_SPARSE || table->storage == COMPONENT_STORAGE_SHARED;
+}
+
+// Size of the value the user passes in, differs from the dense row size for shared components.
+static inline u32 component_table_value_size(ComponentTable* table) {
+    return table->storage == COMPONENT_STORAGE_SHARED ? table->shared->value_size : table->component_size;
+}
+
+static inline SharedRef* component_table_shared_ref(ComponentTable* table, Entity entity) {
+    return (SharedRef*)component_table_get_raw(table, entity);
+}
+
+// Returns the interned value. It is shared with other entities, change it with component_table_set_shared.
+static inline void* component_table_add_shared(ComponentTable* table, Entity entity, const void* value, u32 tick) {
+    SharedValues* shared = table->shared;
+    u32           index  = shared_values_acquire(shared, value);
+    List<Entity>* group  = &shared->entities[index];
+    SharedRef     ref    = { index, group->count };
+
+    list_append(group, entity);
+    component_table_add_raw(table, entity, &ref, tick);
+
+    return shared_values_get(shared, index);
+}
+
+// values points to count tightly packed values or is NULL to zero initialize them.
+// Rows are appended in one go. Runs of equal values take one lookup, every distinct value is interned once
+// and its group list grows once for all of its new members.
+static inline void component_table_add_shared_batch(ComponentTable* table, const Entity* entities, u32 count, const void* values, u32 tick) {
+    SharedValues* shared = table->shared;
+    u32           size   = shared->value_size;
+    u32           first  = table->dense_count;
+
+    component_table_add_batch(table, entities, count, NULL, tick);
+
+    SharedRef* refs = (SharedRef*)table->dense + first;
+
+    // Value index of every row first, refs[i].member is its position in the run until the groups are reserved.
+    for (u32 i = 0; i < count;) {
+        const u8* value = values ? (const u8*)values + i * size : NULL;
+        u32       end   = i + 1;
+
+        while (end < count && (value == NULL || memcmp(value, (const u8*)values + end * size, size) == 0)) end++;
+
+        u32 index = shared_values_acquire(shared, value);
+
+        shared->refcounts[index] += end - i - 1;
+
+        for (u32 k = i; k < end; k++) {
+            refs[k].value = index;
+        }
+
+        i = end;
+    }
+
+    u32* added = AllocatorAlloc(u32, Allocator_Temp, sizeof(u32) * shared->count);
+    Assert(added, "Cannot allocate memory for shared batch.");
+
+    memset(added, 0, sizeof(u32) * shared->count);
+
+    for (u32 i = 0; i < count; i++) {
+        added[refs[i].value]++;
+    }
+
+    for (u32 index = 0; index < shared->count; index++) {
+        List<Entity>* group = &shared->entities[index];
+        u32           total = group->count + added[index];
+
+        if (added[index] > 0 && total > group->length) {
+            list_realloc(group, group->length * 2 > total ? group->length * 2 : total);
+        }
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        List<Entity>* group = &shared->entities[refs[i].value];
+
+        refs[i].member = group->count;
+        group->data[group->count++] = entities[i];
+    }
+}
+
+static inline void component_table_detach_shared(ComponentTable* table, Entity entity) {
+    SharedValues* shared = table->shared;
+    SharedRef*    ref    = component_table_shared_ref(table, entity);
+    List<Entity>* group  = &shared->entities[ref->value];
+    Entity        last   = group->data[group->count - 1];
+
+    group->data[ref->member] = last;
+    component_table_shared_ref(table, last)->member = ref->member;
+    group->count--;
+
+    shared_values_release(shared, ref->value);
+}
+
+static inline void component_table_set_shared(ComponentTable* table, Entity entity, const void* value, u32 tick) {
+    Assertf(component_table_has(table, entity), "Entity (%d) you want to set does not have the component.", entity);
+    SharedValues* shared = table->shared;
+    u32           index  = shared_values_acquire(shared, value);
+
+    if (index == component_table_shared_ref(table, entity)->value) {
+        shared_values_release(shared, index);
+    } else {
+        component_table_detach_shared(table, entity);
+
+        SharedRef* ref = component_table_shared_ref(table, entity);
+
+        ref->value  = index;
+        ref->member = shared->entities[index].count;
+        list_append(&shared->entities[index], entity);
+    }
+
+    component_table_mark_changed(table, entity, tick);
+}
+
+static inline void* component_table_get_shared(ComponentTable* table, Entity entity) {
+    return shared_values_get(table->shared, component_table_shared_ref(table, entity)->value);
+}
+
+// Exchanges two dense rows with their entities and ticks, the sparse index follows both entities.
+static inline void component_table_swap_rows(ComponentTable* table, u32 a, u32 b) {
+    Assert(a != 0 && b != 0 && a < table->dense_count && b < table->dense_count, "Cannot swap rows outside of the component table.");
+    if (a == b) return;
+
+    u8* row_a = (u8*)table->dense + a * table->component_size;
+    u8* row_b = (u8*)table->dense + b * table->component_size;
+    u8  temp[64];
+
+    for (u32 offset = 0; offset < table->component_size; offset += sizeof(temp)) {
+        u32 size = table->component_size - offset < sizeof(temp) ? table->component_size - offset : sizeof(temp);
+
+        memcpy(temp, row_a + offset, size);
+        memcpy(row_a + offset, row_b + offset, size);
+        memcpy(row_b + offset, temp, size);
+    }
+
+    Entity entity_a = table->entity_by_component_id[a];
+    Entity entity_b = table->entity_by_component_id[b];
+    u32    tick_a   = table->ticks[a];
+    u32    tick_b   = table->ticks[b];
+
+    table->entity_by_component_id[a] = entity_b;
+    table->entity_by_component_id[b] = entity_a;
+
+    component_table_sparse_set(table, entity_a, b);
+    component_table_sparse_set(table, entity_b, a);
+    component_table_mark_row(table, a, tick_b);
+    component_table_mark_row(table, b, tick_a);
+}
+
+static inline bool group_contains(Group* group, Entity entity) {
+    u32 id = component_table_sparse_get(group->tables[0], entity);
+    return id != 0 && id <= group->count;
+}
+
+// Moves the entity to the end of the group, once it has every component of it.
+static inline void group_try_add(Group* group, Entity entity) {
+    if (group_contains(group, entity)) return;
+
+    for (u32 i = 0; i < group->tables_count; i++) {
+        if (component_table_has(group->tables[i], entity) == false) return;
+    }
+
+    group->count++;
+
+    for (u32 i = 0; i < group->tables_count; i++) {
+        ComponentTable* table = group->tables[i];
+        component_table_swap_rows(table, component_table_sparse_get(table, entity), group->count);
+    }
+}
+
+// Moves the entity right behind the group, call it before any of its group components is removed.
+static inline void group_try_remove(Group* group, Entity entity) {
+    if (group_contains(group, entity) == false) return;
+
+    for (u32 i = 0; i < group->tables_count; i++) {
+        ComponentTable* table = group->tables[i];
+        component_table_swap_rows(table, component_table_sparse_get(table, entity), group->count);
+    }
+
+    group->count--;
+}
+
+template <typename T>
+static inline T* entity_add_component(EntityManager* em, Entity entity, u32 bit, T component) {
+    return (T*)entity_add_component(em, entity, bit, (const void*)&component);
+}
+
+template <typename T>
+static inline T* entity_get_component(EntityManager* em, ComponentTable* table, u32 bit, Entity entity) {
+    Assertf(table->storage != COMPONENT_STORAGE_TAG, "Cannot get a tag %s, test it with HAS_TAG.", Component_Name_By_Bit[bit]);
+
+    if (table->storage == COMPONENT_STORAGE_CHUNK) {
+        EntitySlot* slot = &em->entities[entity];
+        return (T*)archetype_storage_get(slot->storage, slot->row, bit);
+    }
+
+    return component_table_get<T>(table, entity);
+}
+
+// Mutable access, the component counts as changed in the current tick.
+template <typename T>
+static inline T* entity_get_component_mut(EntityManager* em, ComponentTable* table, u32 bit, Entity entity) {
+    Assertf(table->storage != COMPONENT_STORAGE_SHARED, "Shared %s cannot be changed in place, use SET_SHARED_COMPONENT.", Component_Name_By_Bit[bit]);
+    entity_mark_changed(em, entity, bit);
+    return entity_get_component<T>(em, table, bit, entity);
+}
+
 static inline void entity_print_components(EntityManager* em, Entity entity) {
     Assert(entity != 0, "Cannot use zero entity.");
     auto archetype = em->entities[entity].archetype;
 
     printf("Entity: %d. Components: ", entity);
 
-    for (u32 i = 0; i < COMPONENTS_COUNT; i++) {
-        if (bitmap_test_bit(archetype, i)) {
-            printf("%s, ", Component_Name_By_Bit[i]);
-        }
+    for (u32 bit : bitmap_bits(archetype)) {
+        printf("%s, ", Component_Name_By_Bit[bit]);
     }
     printf("\n");
 }
\ No newline at end of file
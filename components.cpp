@@ -1,24 +1,33 @@
 #include "component_system.h"
 #include "components.h"
 
-ComponentTable TestComponent_s = component_table_make(sizeof(TestComponent));
+ComponentTable TestComponent_s = component_table_make(sizeof(TestComponent), COMPONENT_STORAGE_SPARSE);
 u32 TestComponent_bit = 0;
 
-ComponentTable Transform_s = component_table_make(sizeof(Transform));
+ComponentTable Transform_s = component_table_make(sizeof(Transform), COMPONENT_STORAGE_CHUNK);
 u32 Transform_bit = 1;
 
-ComponentTable TestComponent2_s = component_table_make(sizeof(TestComponent2));
+ComponentTable TestComponent2_s = component_table_make(sizeof(TestComponent2), COMPONENT_STORAGE_SPARSE);
 u32 TestComponent2_bit = 2;
 
-ComponentTable Renderer2D_s = component_table_make(sizeof(Renderer2D));
+ComponentTable Renderer2D_s = component_table_make(sizeof(Renderer2D), COMPONENT_STORAGE_SHARED);
 u32 Renderer2D_bit = 3;
 
-ComponentTable TestComponent3_s = component_table_make(sizeof(TestComponent3));
+ComponentTable TestComponent3_s = component_table_make(sizeof(TestComponent3), COMPONENT_STORAGE_SPARSE);
 u32 TestComponent3_bit = 4;
 
-ComponentTable TestComponent4_s = component_table_make(sizeof(TestComponent4));
+ComponentTable TestComponent4_s = component_table_make(sizeof(TestComponent4), COMPONENT_STORAGE_SPARSE);
 u32 TestComponent4_bit = 5;
 
+ComponentTable TestTag_s = component_table_make(0, COMPONENT_STORAGE_TAG);
+u32 TestTag_bit = 6;
+
+ComponentTable Parent_s = component_table_make(sizeof(Parent), COMPONENT_STORAGE_SPARSE);
+u32 Parent_bit = 7;
+
+ComponentTable WorldTransform_s = component_table_make(sizeof(WorldTransform), COMPONENT_STORAGE_CHUNK);
+u32 WorldTransform_bit = 8;
+
 ComponentTable* All_Components[] = {
   &TestComponent_s,
   &Transform_s,
@@ -26,6 +35,9 @@ ComponentTable* All_Components[] = {
   &Renderer2D_s,
   &TestComponent3_s,
   &TestComponent4_s,
+  &TestTag_s,
+  &Parent_s,
+  &WorldTransform_s,
 };
 const char* Component_Name_By_Bit[] = {
   "TestComponent",
@@ -34,6 +46,9 @@ const char* Component_Name_By_Bit[] = {
   "Renderer2D",
   "TestComponent3",
   "TestComponent4",
+  "TestTag",
+  "Parent",
+  "WorldTransform",
 };
 
 ComponentTable* get_component_table_by_bit(u32 bit) {
@@ -11,8 +11,10 @@ import text;
 // #define PRINT_DEBUG
 
 struct ComponentDeclaration {
-    String type;
-    u32    index;
+    String      type;
+    u32         index;
+    const char* storage;
+    bool        tag;
 };
 
 static inline bool   is_letter(char c);
@@ -78,7 +80,8 @@ int main(int argc, char** argv) {
             Logf("Directive: %s.", directive.text);
 #endif
 
-            if (directive == "DECLARE_COMPONENT") {
+            if (directive == "DECLARE_COMPONENT" || directive == "DECLARE_CHUNK_COMPONENT" || directive == "DECLARE_TAG" ||
+                directive == "DECLARE_SHARED_COMPONENT") {
                 if (input[i] != '(') {
                     Logf("Unexpected token at %d:%d. Expected %c, got %c.", line, i - line_start, '(', input[i]);
                     break;
@@ -89,8 +92,12 @@ int main(int argc, char** argv) {
                 auto type = parse_word(input, &sb, &i);
 
                 ComponentDeclaration component = {
-                    .type = type,
-                    .index = component_bit,
+                    .type    = type,
+                    .index   = component_bit,
+                    .storage = directive == "DECLARE_CHUNK_COMPONENT" ? "COMPONENT_STORAGE_CHUNK" :
+                               directive == "DECLARE_TAG"              ? "COMPONENT_STORAGE_TAG"    :
+                               directive == "DECLARE_SHARED_COMPONENT" ? "COMPONENT_STORAGE_SHARED" : "COMPONENT_STORAGE_SPARSE",
+                    .tag     = directive == "DECLARE_TAG",
                 };
 
                 if (input[i] != ')') {
@@ -167,7 +174,12 @@ int main(int argc, char** argv) {
     sb_append_line(&cpp_out);
 
     for (auto c : components) {
-        sprintf(buf, "ComponentTable %s_s = component_table_make(sizeof(%s));", c.type.text, c.type.text);
+        // Tags have no type to take the size of.
+        if (c.tag) {
+            sprintf(buf, "ComponentTable %s_s = component_table_make(0, %s);", c.type.text, c.storage);
+        } else {
+            sprintf(buf, "ComponentTable %s_s = component_table_make(sizeof(%s), %s);", c.type.text, c.type.text, c.storage);
+        }
         sb_append_line(&cpp_out, buf);
 
         sprintf(buf, "u32 %s_bit = %d;", c.type.text, c.index);
@@ -24,52 +24,224 @@ struct TestComponent4 {
     u32 a;
 };
 
+// Transform of the entity is relative to the parent, the handle is checked before use.
+struct Parent {
+    u32 entity;
+    u32 generation;
+};
+
+// Archetypes are walked chunk by chunk, chunk stored components are read straight from their columns,
+// sparse stored ones are looked up in their component tables.
 #define BEGIN_ITERATE_COMPONENT(em, type) \
     Archetype __query_mask = bitmap_make<ARCHETYPE_BIT_COUNT>(GET_COMPONENT_BIT(type));\
     \
-    for (auto [__arch, __list] : em->archetypes) {\
-        Archetype __intersection = bitmap_and(__arch, __query_mask);\
-        if (__intersection != __query_mask) continue;\
-        if (__list.count == 0) continue;\
+    for (auto [__arch, __storage] : em->archetypes) {\
+        if (bitmap_contains(__arch, __query_mask) == false) continue;\
+        if (__storage->count == 0) continue;\
         \
-        for (auto entity : __list) {\
-            type* type##_c = GET_COMPONENT(type, entity);\
+        for (u32 __chunk = 0; __chunk < __storage->chunks.count; __chunk++) {\
+            u32     __chunk_count = archetype_storage_chunk_count(__storage, __chunk);\
+            Entity* __entities    = archetype_storage_entities(__storage, __chunk);\
+            type*   __column_##type = (type*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type));\
+            \
+            for (u32 __row = 0; __row < __chunk_count; __row++) {\
+                Entity entity = __entities[__row];\
+                type* type##_c = __column_##type ? &__column_##type[__row] : component_table_get<type>(&type##_s, entity);\
 
-#define END_ITERATE_COMPONENT() }}
+#define END_ITERATE_COMPONENT() }}}
 
 #define BEGIN_ITERATE_COMPONENTS_2(em, type1, type2) \
     Archetype __query_mask = bitmap_make<ARCHETYPE_BIT_COUNT>(GET_COMPONENT_BIT(type1), GET_COMPONENT_BIT(type2));\
     \
-    for (auto [__arch, __list] : em->archetypes) {\
-        Archetype __intersection = bitmap_and(__arch, __query_mask);\
-        if (__intersection != __query_mask) continue;\
-        if (__list.count == 0) continue;\
+    for (auto [__arch, __storage] : em->archetypes) {\
+        if (bitmap_contains(__arch, __query_mask) == false) continue;\
+        if (__storage->count == 0) continue;\
+        \
+        for (u32 __chunk = 0; __chunk < __storage->chunks.count; __chunk++) {\
+            u32     __chunk_count = archetype_storage_chunk_count(__storage, __chunk);\
+            Entity* __entities    = archetype_storage_entities(__storage, __chunk);\
+            type1*  __column_##type1 = (type1*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type1));\
+            type2*  __column_##type2 = (type2*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type2));\
+            \
+            for (u32 __row = 0; __row < __chunk_count; __row++) {\
+                Entity entity = __entities[__row];\
+                type1* type1##_c = __column_##type1 ? &__column_##type1[__row] : component_table_get<type1>(&type1##_s, entity);\
+                type2* type2##_c = __column_##type2 ? &__column_##type2[__row] : component_table_get<type2>(&type2##_s, entity);\
+
+#define END_ITERATE_COMPONENTS_2() } } }\
+
+#define BEGIN_ITERATE_QUERY(query, type) \
+    for (ArchetypeStorage* __storage : (query)->archetypes) {\
+        if (__storage->count == 0) continue;\
+        \
+        for (u32 __chunk = 0; __chunk < __storage->chunks.count; __chunk++) {\
+            u32     __chunk_count = archetype_storage_chunk_count(__storage, __chunk);\
+            Entity* __entities    = archetype_storage_entities(__storage, __chunk);\
+            type*   __column_##type = (type*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type));\
+            \
+            for (u32 __row = 0; __row < __chunk_count; __row++) {\
+                Entity entity = __entities[__row];\
+                type* type##_c = __column_##type ? &__column_##type[__row] : component_table_get<type>(&type##_s, entity);\
+
+#define BEGIN_ITERATE_QUERY_2(query, type1, type2) \
+    for (ArchetypeStorage* __storage : (query)->archetypes) {\
+        if (__storage->count == 0) continue;\
+        \
+        for (u32 __chunk = 0; __chunk < __storage->chunks.count; __chunk++) {\
+            u32     __chunk_count = archetype_storage_chunk_count(__storage, __chunk);\
+            Entity* __entities    = archetype_storage_entities(__storage, __chunk);\
+            type1*  __column_##type1 = (type1*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type1));\
+            type2*  __column_##type2 = (type2*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type2));\
+            \
+            for (u32 __row = 0; __row < __chunk_count; __row++) {\
+                Entity entity = __entities[__row];\
+                type1* type1##_c = __column_##type1 ? &__column_##type1[__row] : component_table_get<type1>(&type1##_s, entity);\
+                type2* type2##_c = __column_##type2 ? &__column_##type2[__row] : component_table_get<type2>(&type2##_s, entity);\
+
+#define END_ITERATE_QUERY() } } }\
+
+// Only rows, where any of the query changed components was written after the since tick.
+// Chunks, whose max tick is not newer, are skipped without touching their rows.
+#define BEGIN_ITERATE_QUERY_CHANGED(query, since, type) \
+    for (ArchetypeStorage* __storage : (query)->archetypes) {\
+        if (__storage->count == 0) continue;\
+        \
+        for (u32 __chunk = 0; __chunk < __storage->chunks.count; __chunk++) {\
+            if (query_chunk_changed(query, __storage, __chunk, since) == false) continue;\
+            \
+            u32     __chunk_count = archetype_storage_chunk_count(__storage, __chunk);\
+            Entity* __entities    = archetype_storage_entities(__storage, __chunk);\
+            type*   __column_##type = (type*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type));\
+            \
+            for (u32 __row = 0; __row < __chunk_count; __row++) {\
+                Entity entity = __entities[__row];\
+                if (query_row_changed(query, __storage, __chunk, __row, entity, since) == false) continue;\
+                type* type##_c = __column_##type ? &__column_##type[__row] : component_table_get<type>(&type##_s, entity);\
+
+#define BEGIN_ITERATE_QUERY_CHANGED_2(query, since, type1, type2) \
+    for (ArchetypeStorage* __storage : (query)->archetypes) {\
+        if (__storage->count == 0) continue;\
+        \
+        for (u32 __chunk = 0; __chunk < __storage->chunks.count; __chunk++) {\
+            if (query_chunk_changed(query, __storage, __chunk, since) == false) continue;\
+            \
+            u32     __chunk_count = archetype_storage_chunk_count(__storage, __chunk);\
+            Entity* __entities    = archetype_storage_entities(__storage, __chunk);\
+            type1*  __column_##type1 = (type1*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type1));\
+            type2*  __column_##type2 = (type2*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type2));\
+            \
+            for (u32 __row = 0; __row < __chunk_count; __row++) {\
+                Entity entity = __entities[__row];\
+                if (query_row_changed(query, __storage, __chunk, __row, entity, since) == false) continue;\
+                type1* type1##_c = __column_##type1 ? &__column_##type1[__row] : component_table_get<type1>(&type1##_s, entity);\
+                type2* type2##_c = __column_##type2 ? &__column_##type2[__row] : component_table_get<type2>(&type2##_s, entity);\
+
+// Marks the component of the current row as written, use inside of any BEGIN_ITERATE_* loop.
+#define MARK_CHANGED(type, em) \
+    (__column_##type ? archetype_storage_mark_changed_at(__storage, __chunk, __row, GET_COMPONENT_BIT(type), (em)->tick)\
+                     : component_table_mark_changed(&type##_s, entity, (em)->tick))
+
+// Iterates a QueryRange handed to a query_par_for_each procedure.
+#define BEGIN_ITERATE_RANGE(range, type) \
+    {\
+        ArchetypeStorage* __storage       = (range)->storage;\
+        u32               __chunk         = (range)->chunk;\
+        Entity*           __entities      = archetype_storage_entities(__storage, __chunk);\
+        type*             __column_##type = (type*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type));\
+        \
+        for (u32 __row = (range)->first; __row < (range)->first + (range)->count; __row++) {\
+            Entity entity = __entities[__row];\
+            type* type##_c = __column_##type ? &__column_##type[__row] : component_table_get<type>(&type##_s, entity);\
+
+#define BEGIN_ITERATE_RANGE_2(range, type1, type2) \
+    {\
+        ArchetypeStorage* __storage        = (range)->storage;\
+        u32               __chunk          = (range)->chunk;\
+        Entity*           __entities       = archetype_storage_entities(__storage, __chunk);\
+        type1*            __column_##type1 = (type1*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type1));\
+        type2*            __column_##type2 = (type2*)archetype_storage_column(__storage, __chunk, GET_COMPONENT_BIT(type2));\
         \
-        for (auto entity : __list) {\
-            type1* type1##_c = GET_COMPONENT(type1, entity);\
-            type2* type2##_c = GET_COMPONENT(type2, entity);\
+        for (u32 __row = (range)->first; __row < (range)->first + (range)->count; __row++) {\
+            Entity entity = __entities[__row];\
+            type1* type1##_c = __column_##type1 ? &__column_##type1[__row] : component_table_get<type1>(&type1##_s, entity);\
+            type2* type2##_c = __column_##type2 ? &__column_##type2[__row] : component_table_get<type2>(&type2##_s, entity);\
 
-#define END_ITERATE_COMPONENTS_2() } }\
+#define END_ITERATE_RANGE() } }\
+
+#define QUERY_MASK(...) bitmap_make<ARCHETYPE_BIT_COUNT>(__VA_ARGS__)
+
+#define COMPONENT_SPAN(type, values) ComponentSpan { .bit = GET_COMPONENT_BIT(type), .data = (const type*)(values) }
 
 #define ADD_COMPONENT(type, em, entity, component) \
-    archetype_remove(em, entity);\
-    component_table_add(&type##_s, entity, component);\
-    ENTITY_SET_COMPONENT_BIT(type, em, entity);\
-    archetype_add(em, entity);\
+    entity_add_component<type>(em, entity, GET_COMPONENT_BIT(type), component);\
 
 #define REMOVE_COMPONENT(type, em, entity) \
-    archetype_remove(em, entity);\
-    component_table_remove(&type##_s, entity);\
-    ENTITY_CLEAR_COMPONENT_BIT(type, em, entity);\
-    archetype_add(em, entity);\
+    entity_remove_component(em, entity, GET_COMPONENT_BIT(type));\
 
 #define REMOVE_COMPONENT_IF_EXIST(type, em, entity) \
     if (HAS_COMPONENT(type, em, entity)) {\
         REMOVE_COMPONENT(type, em, entity);\
     }\
 
+#define ECB_ADD_COMPONENT(type, ecb, handle, component) \
+    { type __component = component; ecb_add(ecb, handle, GET_COMPONENT_BIT(type), &__component); }\
+
+#define ECB_SET_COMPONENT(type, ecb, handle, component) \
+    { type __component = component; ecb_set(ecb, handle, GET_COMPONENT_BIT(type), &__component); }\
+
+#define ECB_REMOVE_COMPONENT(type, ecb, handle) \
+    ecb_remove(ecb, handle, GET_COMPONENT_BIT(type));\
+
+// Tags are declared with #DECLARE_TAG(name), they have no type and no table, only the archetype bit.
+#define ADD_TAG(tag, em, entity) \
+    entity_add_component(em, entity, GET_COMPONENT_BIT(tag), NULL);\
+
+#define REMOVE_TAG(tag, em, entity) \
+    entity_remove_component(em, entity, GET_COMPONENT_BIT(tag));\
+
+#define ECB_ADD_TAG(tag, ecb, handle) \
+    ecb_add(ecb, handle, GET_COMPONENT_BIT(tag), NULL);\
+
+#define ECB_REMOVE_TAG(tag, ecb, handle) \
+    ecb_remove(ecb, handle, GET_COMPONENT_BIT(tag));\
+
+#define HAS_TAG(tag, em, entity) ENTITY_TEST_COMPONENT_BIT(tag, em, entity)
+
+// Shared components are declared with #DECLARE_SHARED_COMPONENT(type), equal values are stored once.
+// GET_COMPONENT returns the interned value, change it only with SET_SHARED_COMPONENT.
+#define SET_SHARED_COMPONENT(type, em, entity, value) \
+    { type __value = value; entity_set_shared(em, entity, GET_COMPONENT_BIT(type), &__value); }\
+
+// Once per distinct value of a shared component, type##_c is the value and group holds group_count entities.
+// The group must not change inside the loop.
+#define BEGIN_ITERATE_SHARED(type) \
+    for (u32 __value = 0; __value < type##_s.shared->count; __value++) {\
+        if (type##_s.shared->refcounts[__value] == 0) continue;\
+        \
+        type*   type##_c    = (type*)shared_values_get(type##_s.shared, __value);\
+        Entity* group       = type##_s.shared->entities[__value].data;\
+        u32     group_count = type##_s.shared->entities[__value].count;\
+
+#define END_ITERATE_SHARED() }\
+
+// Owning group made with group_make, both types have to be owned by it.
+// Rows 1..count of the owned tables hold the group in the same order, so components are read without lookups.
+// Adding or removing group components inside the loop reorders the rows.
+#define BEGIN_ITERATE_GROUP_2(owner, type1, type2) \
+    Assert(type1##_s.group == (owner) && type2##_s.group == (owner), "Group does not own " #type1 " and " #type2 ".");\
+    \
+    for (u32 __row = 1; __row <= (owner)->count; __row++) {\
+        Entity entity    = type1##_s.entity_by_component_id[__row];\
+        type1* type1##_c = &((type1*)type1##_s.dense)[__row];\
+        type2* type2##_c = &((type2*)type2##_s.dense)[__row];\
+        (void)entity;\
+
+#define END_ITERATE_GROUP() }\
+
 #define HAS_COMPONENT(type, em, entity) ENTITY_TEST_COMPONENT_BIT(type, em, entity)
-#define GET_COMPONENT(type, entity)     component_table_get<type>(&type##_s, entity)
+#define GET_COMPONENT(type, em, entity) entity_get_component<type>(em, &type##_s, GET_COMPONENT_BIT(type), entity)
+#define GET_COMPONENT_MUT(type, em, entity) entity_get_component_mut<type>(em, &type##_s, GET_COMPONENT_BIT(type), entity)
+#define GET_COMPONENT_IF_EXIST(type, em, entity) (HAS_COMPONENT(type, em, entity) ? GET_COMPONENT(type, em, entity) : NULL)
 
 #define GET_COMPONENT_BIT(type)    type##_bit
 #define COMPONENTS_GET_COUNT(type) type##_s.dense_count
@@ -89,8 +261,11 @@ extern const char*     Component_Name_By_Bit[];
 extern ComponentTable* get_component_table_by_bit(u32 bit);
 
 #DECLARE_COMPONENT(TestComponent)
-#DECLARE_COMPONENT(Transform)
+#DECLARE_CHUNK_COMPONENT(Transform)
 #DECLARE_COMPONENT(TestComponent2)
-#DECLARE_COMPONENT(Renderer2D)
+#DECLARE_SHARED_COMPONENT(Renderer2D)
 #DECLARE_COMPONENT(TestComponent3)
 #DECLARE_COMPONENT(TestComponent4)
+#DECLARE_TAG(TestTag)
+#DECLARE_COMPONENT(Parent)
+#DECLARE_CHUNK_COMPONENT(WorldTransform)
@@ -5,6 +5,8 @@
 #include "memory.h"
 #include "component_system.h"
 #include "components.h"
+#include "jobs.h"
+#include <chrono>
 
 import math;
 import bitmap;
@@ -12,23 +14,173 @@ import bitmap;
 #define START_ENTITY_LENGTH 1024
 #define REALLOC_STEP 256
 
+#define ECB_INITIAL_COMMANDS_LENGTH 256
+#define ECB_INITIAL_DATA_LENGTH     4096
+
+struct EntityRemoval {
+    ArchetypeStorage* storage;
+    u32               row;
+    Entity            entity;
+};
+
+struct EntityChange {
+    EntityHandle      entity;
+    ArchetypeStorage* from;
+    ArchetypeStorage* to;
+    u32               first_command;
+    u32               commands_count;
+};
+
+static inline u32 align_up(u32 value, u32 alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Stable bottom-up merge sort, scratch has to hold count items.
+template <typename T, typename Less>
+static inline void merge_sort(T* items, T* scratch, u32 count, Less less) {
+    T* src = items;
+    T* dst = scratch;
+
+    for (u32 width = 1; width < count; width *= 2) {
+        for (u32 lo = 0; lo < count; lo += 2 * width) {
+            u32 mid = min(lo + width, count);
+            u32 hi  = min(lo + 2 * width, count);
+            u32 a   = lo;
+            u32 b   = mid;
+
+            for (u32 k = lo; k < hi; k++) {
+                if (a < mid && (b >= hi || !less(src[b], src[a]))) {
+                    dst[k] = src[a++];
+                } else {
+                    dst[k] = src[b++];
+                }
+            }
+        }
+
+        T* temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    if (src != items) {
+        memcpy(items, src, sizeof(T) * count);
+    }
+}
+
+static inline bool storage_has_bit(ArchetypeStorage* storage, u32 bit) {
+    return storage && bitmap_test_bit(storage->archetype, bit);
+}
+
+// Drops the chunks after the last row, the first one becomes the spare, only the others are freed.
+static inline void archetype_storage_release_chunks(ArchetypeStorage* storage) {
+    u32 used = (storage->count + storage->chunk_capacity - 1) / storage->chunk_capacity;
+
+    while (storage->chunks.count > used) {
+        u8* chunk = storage->chunks.data[--storage->chunks.count];
+
+        if (storage->spare) {
+            COMPONENTS_FREE(chunk);
+        } else {
+            storage->spare = chunk;
+        }
+    }
+}
+
+static inline void archetype_storage_append_chunk(ArchetypeStorage* storage) {
+    u8* data = storage->spare;
+
+    if (data) {
+        storage->spare = NULL;
+    } else {
+        data = COMPONENTS_MALLOC(u8, ARCHETYPE_CHUNK_SIZE);
+        Assert(data, "Cannot allocate memory for archetype chunk");
+    }
+
+    for (u32 i = 0; i < storage->columns_count; i++) {
+        *(u32*)(data + storage->columns[storage->column_bits[i]].chunk_tick_offset) = 0;
+    }
+
+    list_append(&storage->chunks, data);
+}
+
+// Copies the columns both storages have, together with their ticks.
+static inline void archetype_storage_copy_row(ArchetypeStorage* to, u32 to_row, ArchetypeStorage* from, u32 from_row) {
+    u32 from_chunk = from_row / from->chunk_capacity;
+    u32 from_index = from_row % from->chunk_capacity;
+
+    for (u32 i = 0; i < to->columns_count; i++) {
+        u32 bit = to->column_bits[i];
+
+        if (from->columns[bit].size == 0) continue;
+
+        memcpy(archetype_storage_get(to, to_row, bit),
+               archetype_storage_get(from, from_row, bit),
+               to->columns[bit].size);
+
+        archetype_storage_mark_changed(to, to_row, bit, archetype_storage_ticks(from, from_chunk, bit)[from_index]);
+    }
+}
+
 void entity_manager_make(EntityManager* em) {
     Assert(em, "Entity manager is null");
 
-    em->archetypes      = table_make<Archetype, List<Entity>>();
-    em->entities        = (EntitySlot*)malloc(sizeof(EntitySlot) * START_ENTITY_LENGTH);
-    em->free            = (u32*)malloc(sizeof(u32) * START_ENTITY_LENGTH);
+    em->archetypes      = table_make<Archetype, ArchetypeStorage*>();
+    em->queries         = list_make<Query*>();
+    em->root_edges      = COMPONENTS_MALLOC(ArchetypeStorage*, sizeof(ArchetypeStorage*) * COMPONENTS_COUNT);
+    em->entities        = COMPONENTS_MALLOC(EntitySlot, sizeof(EntitySlot) * START_ENTITY_LENGTH);
+    em->free            = COMPONENTS_MALLOC(u32, sizeof(u32) * START_ENTITY_LENGTH);
+    em->tick            = 1;
+    em->structure_version = 0;
     em->entities_count  = 1;
     em->entities_length = START_ENTITY_LENGTH;
     em->free_count      = 0;
 
     Assert(em->entities, "Cannot allocate memory for entities array");
     Assert(em->free, "Cannot allocate memory for free entities array");
+    Assert(em->root_edges, "Cannot allocate memory for archetype edges");
 
-    memset(em->entities, 0, sizeof(EntitySlot) * START_ENTITY_LENGTH);
+    for (u32 i = 0; i < START_ENTITY_LENGTH; i++) {
+        em->entities[i] = {};
+    }
+
+    memset(em->root_edges, 0, sizeof(ArchetypeStorage*) * COMPONENTS_COUNT);
     memset(em->free, 0, sizeof(u32) * START_ENTITY_LENGTH);
 }
 
+// Writes from now on get a new tick. Returns the tick, which was current until now,
+// a system, which remembers it, will see every later write as changed.
+u32 entity_manager_advance_tick(EntityManager* em) {
+    return em->tick++;
+}
+
+// Releases the memory kept around for reuse. Call it after a level unload or any other large despawn.
+void entity_manager_trim(EntityManager* em) {
+    for (auto [archetype, storage] : em->archetypes) {
+        archetype_storage_trim(storage);
+    }
+
+    for (u32 bit = 0; bit < COMPONENTS_COUNT; bit++) {
+        component_table_trim(get_component_table_by_bit(bit));
+    }
+}
+
+static inline void entity_manager_reserve(EntityManager* em, u32 length) {
+    if (length <= em->entities_length) return;
+
+    u32 new_len = max(length, max(em->entities_length * 2, em->entities_length + REALLOC_STEP));
+    em->entities = (EntitySlot*)COMPONENTS_REALLOC(em->entities, sizeof(EntitySlot) * new_len);
+    em->free = (u32*)COMPONENTS_REALLOC(em->free, sizeof(u32) * new_len);
+
+    Assert(em->entities, "Cannot reallocate memory for entities");
+    Assert(em->free, "Cannot reallocate memory for entities");
+
+    for (u32 i = em->entities_length; i < new_len; i++) {
+        em->entities[i] = {};
+    }
+
+    em->entities_length = new_len;
+}
+
 EntityHandle entity_create(EntityManager* em) {
     u32 id = 0;
 
@@ -37,16 +189,7 @@ EntityHandle entity_create(EntityManager* em) {
     } else {
         id = em->entities_count++;
 
-        if (id >= em->entities_length) {
-            u32 new_len = em->entities_length + REALLOC_STEP;
-            em->entities = (EntitySlot*)realloc(em->entities, sizeof(EntitySlot) * new_len);
-            em->free = (u32*)realloc(em->free, sizeof(u32) * new_len);
-
-            em->entities_length = new_len;
-
-            Assert(em->entities, "Cannot reallocate memory for entities");
-            Assert(em->free, "Cannot reallocate memory for entities");
-        }
+        entity_manager_reserve(em, id + 1);
     }
     
     EntityHandle handle = {
@@ -67,19 +210,21 @@ void entity_destroy(EntityManager* em, EntityHandle handle) {
 
     Assert(entity_is_alive(em, handle), "Cannot destroy dead entity");
 
-    em->entities[handle.id].generation++;
+    EntitySlot* slot = &em->entities[handle.id];
 
-    archetype_remove(em, handle.id);
+    slot->generation++;
+
+    for (u32 bit : bitmap_bits(slot->archetype)) {
+        ComponentTable* table = get_component_table_by_bit(bit);
 
-    for (u32 i = 0; i < COMPONENTS_COUNT; i++) {
-        if (bitmap_test_bit(em->entities[handle.id].archetype, i)) {
-            auto table = get_component_table_by_bit(i);
-            archetype_remove(em, handle.id);
+        if (component_table_is_sparse(table)) {
             component_table_remove(table, handle.id);
-            bitmap_clear_bit(em->entities[handle.id].archetype, i);
         }
     }
 
+    archetype_remove(em, handle.id);
+    bitmap_clear_all(slot->archetype);
+
     if (em->free_count > 0 && 
         em->free[em->free_count - 1] < handle.id) {
         em->free[em->free_count] = em->free[em->free_count - 1];
@@ -91,31 +236,1026 @@ void entity_destroy(EntityManager* em, EntityHandle handle) {
     em->free_count++;
 }
 
+// Creates count entities straight in the archetype. Rows in the archetype storage and in the component tables
+// are reserved once for the whole batch. Components without a span are zero initialized.
+void entity_create_batch(EntityManager* em, u32 count, Archetype archetype, EntityHandle* out_handles, ComponentSpan* spans, u32 spans_count) {
+    Assert(out_handles, "Cannot create entities without output handles.");
+    if (count == 0) return;
+
+    u32 reused = min(count, em->free_count);
+
+    entity_manager_reserve(em, em->entities_count + (count - reused));
+
+    Entity* entities = AllocatorAlloc(Entity, Allocator_Temp, sizeof(Entity) * count);
+    Assert(entities, "Cannot allocate memory for batch entities.");
+
+    for (u32 i = 0; i < count; i++) {
+        u32 id = i < reused ? em->free[--em->free_count] : em->entities_count++;
+
+        entities[i]    = id;
+        out_handles[i] = {
+            .id         = id,
+            .generation = em->entities[id].generation,
+        };
+    }
+
+    if (archetype == Archetype_Zero) return;
+
+    ArchetypeStorage* storage = archetype_storage_get_or_make(em, archetype);
+    u32               first   = archetype_storage_push_batch(storage, entities, count, em->tick);
+
+    em->structure_version++;
+
+    for (u32 i = 0; i < count; i++) {
+        EntitySlot* slot = &em->entities[entities[i]];
+
+        slot->archetype = archetype;
+        slot->storage   = storage;
+        slot->row       = first + i;
+    }
+
+    for (u32 bit : bitmap_bits(archetype)) {
+        const void* data = NULL;
+
+        for (u32 i = 0; i < spans_count; i++) {
+            if (spans[i].bit == bit) {
+                data = spans[i].data;
+                break;
+            }
+        }
+
+        ComponentTable* table = get_component_table_by_bit(bit);
+
+        if (table->storage == COMPONENT_STORAGE_CHUNK) {
+            if (data) archetype_storage_set_rows(storage, first, count, bit, data, em->tick);
+        } else if (table->storage == COMPONENT_STORAGE_SPARSE) {
+            component_table_add_batch(table, entities, count, data, em->tick);
+        } else if (table->storage == COMPONENT_STORAGE_SHARED) {
+            component_table_add_shared_batch(table, entities, count, data, em->tick);
+        }
+    }
+
+#ifdef DEBUG
+    for (u32 i = 0; i < spans_count; i++) {
+        Assertf(bitmap_test_bit(archetype, spans[i].bit), "Span for component %s is not a part of the archetype.", Component_Name_By_Bit[spans[i].bit]);
+    }
+#endif
+}
+
+// Rows go from the last one down, so a removed row is always filled by a row, which stays.
+static void archetype_storage_remove_rows(EntityManager* em, ArchetypeStorage* storage, const EntityRemoval* removals, u32 count) {
+    u32 capacity = storage->chunk_capacity;
+
+    for (u32 i = 0; i < count; i++) {
+        u32 row  = removals[i].row;
+        u32 last = storage->count - 1;
+
+        Assertf(row < storage->count, "Row (%d) is outside the bounds of the archetype storage (%d).", row, storage->count);
+
+        if (row != last) {
+            Entity moved = archetype_storage_entities(storage, last / capacity)[last % capacity];
+
+            archetype_storage_entities(storage, row / capacity)[row % capacity] = moved;
+            archetype_storage_copy_row(storage, row, storage, last);
+
+            em->entities[moved].row = row;
+        }
+
+        storage->count--;
+    }
+
+    archetype_storage_release_chunks(storage);
+}
+
+// Sparse components are removed table by table, archetype rows storage by storage in one swap-back pass each.
+void entity_destroy_batch(EntityManager* em, EntityHandle* handles, u32 count) {
+    if (count == 0) return;
+
+    EntityRemoval* removals = AllocatorAlloc(EntityRemoval, Allocator_Temp, sizeof(EntityRemoval) * count);
+    EntityRemoval* scratch  = AllocatorAlloc(EntityRemoval, Allocator_Temp, sizeof(EntityRemoval) * count);
+    Archetype      touched  = Archetype_Zero;
+
+    Assert(removals && scratch, "Cannot allocate memory for batch destroy.");
+
+    for (u32 i = 0; i < count; i++) {
+        EntityHandle handle = handles[i];
+
+        Assertf(handle.id < em->entities_length, "Cannot destroy an entity. Entity index is outside the bounds of the manager capacity. Id: %d, capacity: %d", handle.id, em->entities_length);
+        Assert(entity_is_alive(em, handle), "Cannot destroy dead entity");
+
+        EntitySlot* slot = &em->entities[handle.id];
+
+        // Also catches the same entity twice in the batch.
+        slot->generation++;
+
+        removals[i] = {
+            .storage = slot->storage,
+            .row     = slot->row,
+            .entity  = handle.id,
+        };
+
+        touched = bitmap_or(touched, slot->archetype);
+    }
+
+    for (u32 bit : bitmap_bits(touched)) {
+        ComponentTable* table = get_component_table_by_bit(bit);
+
+        if (component_table_is_sparse(table) == false) continue;
+
+        for (u32 i = 0; i < count; i++) {
+            if (bitmap_test_bit(em->entities[removals[i].entity].archetype, bit)) {
+                component_table_remove(table, removals[i].entity);
+            }
+        }
+    }
+
+    merge_sort(removals, scratch, count, [](const EntityRemoval& a, const EntityRemoval& b) {
+        if (a.storage != b.storage) return (u64)a.storage < (u64)b.storage;
+        return a.row > b.row;
+    });
+
+    for (u32 i = 0; i < count;) {
+        ArchetypeStorage* storage = removals[i].storage;
+        u32               end     = i + 1;
+
+        while (end < count && removals[end].storage == storage) end++;
+
+        if (storage) archetype_storage_remove_rows(em, storage, removals + i, end - i);
+
+        i = end;
+    }
+
+    em->structure_version++;
+
+    for (u32 i = 0; i < count; i++) {
+        Entity      entity = removals[i].entity;
+        EntitySlot* slot   = &em->entities[entity];
+
+        slot->storage = NULL;
+        slot->row     = 0;
+        bitmap_clear_all(slot->archetype);
+
+        if (em->free_count > 0 &&
+            em->free[em->free_count - 1] < entity) {
+            em->free[em->free_count]     = em->free[em->free_count - 1];
+            em->free[em->free_count - 1] = entity;
+        } else {
+            em->free[em->free_count] = entity;
+        }
+
+        em->free_count++;
+    }
+}
+
 Archetype& entity_get_archetype(EntityManager* em, Entity entity) {
     return em->entities[entity].archetype;
 }
 
+void entity_mark_changed(EntityManager* em, Entity entity, u32 bit) {
+    EntitySlot* slot = &em->entities[entity];
+    Assertf(bitmap_test_bit(slot->archetype, bit), "Entity(%d) does not have the component, you want to mark. Component bit: %d, name: %s", entity, bit, Component_Name_By_Bit[bit]);
+
+    ComponentTable* table = get_component_table_by_bit(bit);
+    Assertf(table->storage != COMPONENT_STORAGE_TAG, "Tag %s does not track changes.", Component_Name_By_Bit[bit]);
+
+    if (table->storage == COMPONENT_STORAGE_CHUNK) {
+        archetype_storage_mark_changed(slot->storage, slot->row, bit, em->tick);
+    } else {
+        component_table_mark_changed(table, entity, em->tick);
+    }
+}
+
+void* entity_add_component(EntityManager* em, Entity entity, u32 bit, const void* component) {
+    EntitySlot* slot = &em->entities[entity];
+    Assertf(bitmap_test_bit(slot->archetype, bit) == false, "Entity(%d) already has the component. Component bit: %d, name: %s", entity, bit, Component_Name_By_Bit[bit]);
+
+    archetype_move_to(em, entity, archetype_storage_add_edge(em, slot->storage, bit));
+
+    ComponentTable* table = get_component_table_by_bit(bit);
+
+    if (table->storage == COMPONENT_STORAGE_CHUNK) {
+        void* data = archetype_storage_get(slot->storage, slot->row, bit);
+        memcpy(data, component, table->component_size);
+        return data;
+    }
+
+    // Tags are only the bit, which the move above already set.
+    if (table->storage == COMPONENT_STORAGE_TAG)    return NULL;
+    if (table->storage == COMPONENT_STORAGE_SHARED) return component_table_add_shared(table, entity, component, em->tick);
+
+    return component_table_add_raw(table, entity, component, em->tick);
+}
+
+void entity_remove_component(EntityManager* em, Entity entity, u32 bit) {
+    EntitySlot* slot = &em->entities[entity];
+    Assertf(bitmap_test_bit(slot->archetype, bit), "Entity(%d) does not have the component, you want to remove. Component bit: %d, name: %s", entity, bit, Component_Name_By_Bit[bit]);
+
+    ComponentTable* table = get_component_table_by_bit(bit);
+
+    if (component_table_is_sparse(table)) {
+        component_table_remove(table, entity);
+    }
+
+    archetype_move_to(em, entity, archetype_storage_remove_edge(em, slot->storage, bit));
+}
+
+// Moves the entity to the group of the new value, the old value is dropped once no entity uses it.
+void entity_set_shared(EntityManager* em, Entity entity, u32 bit, const void* value) {
+    Assertf(bitmap_test_bit(em->entities[entity].archetype, bit), "Entity(%d) does not have the component, you want to set. Component bit: %d, name: %s", entity, bit, Component_Name_By_Bit[bit]);
+
+    ComponentTable* table = get_component_table_by_bit(bit);
+    Assertf(table->storage == COMPONENT_STORAGE_SHARED, "Component %s is not shared.", Component_Name_By_Bit[bit]);
+
+    component_table_set_shared(table, entity, value, em->tick);
+}
+
 void archetype_remove(EntityManager* em, Entity entity) {
-    auto archetype = entity_get_archetype(em, entity);
-    if (archetype == Archetype_Zero) return;
+    EntitySlot* slot = &em->entities[entity];
+    if (slot->storage == NULL) return;
+
+    archetype_storage_remove(em, slot->storage, slot->row);
+
+    slot->storage = NULL;
+    slot->row     = 0;
+}
+
+void archetype_add(EntityManager* em, Entity entity) {
+    EntitySlot* slot = &em->entities[entity];
+    Assert(slot->storage == NULL, "Entity is already stored in an archetype, use archetype_move instead.");
+    if (slot->archetype == Archetype_Zero) return;
+
+    slot->storage = archetype_storage_get_or_make(em, slot->archetype);
+    slot->row     = archetype_storage_push(slot->storage, entity, em->tick);
 
-    if (table_contains(&em->archetypes, archetype)) {
-        auto list = table_get_ptr(&em->archetypes, archetype);
-        list_remove(list, entity);
-        if (list->count == 0) {
-            list_free(list);
-            table_remove(&em->archetypes, archetype);
+    em->structure_version++;
+}
+
+void archetype_move(EntityManager* em, Entity entity, Archetype archetype) {
+    ArchetypeStorage* to = NULL;
+
+    if (archetype != Archetype_Zero) {
+        to = archetype_storage_get_or_make(em, archetype);
+    }
+
+    archetype_move_to(em, entity, to);
+}
+
+// Moves the entity with all of its chunk stored components into another archetype storage.
+// NULL storage is the empty archetype. Columns, which do not exist in the target storage, are dropped, new columns are zeroed.
+// Moved columns keep their ticks, new columns count as changed.
+void archetype_move_to(EntityManager* em, Entity entity, ArchetypeStorage* to) {
+    EntitySlot*       slot = &em->entities[entity];
+    ArchetypeStorage* from = slot->storage;
+    u32               row  = 0;
+
+    if (from == to) return;
+
+    em->structure_version++;
+
+    if (to) {
+        row = archetype_storage_push(to, entity, em->tick);
+
+        if (from) {
+            archetype_storage_copy_row(to, row, from, slot->row);
         }
     }
+
+    if (from) {
+        archetype_storage_remove(em, from, slot->row);
+    }
+
+    slot->archetype = to ? to->archetype : Archetype_Zero;
+    slot->storage   = to;
+    slot->row       = row;
 }
 
-void archetype_add(EntityManager* em, Entity entity) {
-    auto archetype = entity_get_archetype(em, entity);
-    
-    if (table_contains(&em->archetypes, archetype) == false) {
-        auto list = list_make<Entity>();
-        table_add(&em->archetypes, archetype, list);
+// Archetype graph. Edges are resolved once by hashing the target archetype, then cached in both directions.
+ArchetypeStorage* archetype_storage_add_edge(EntityManager* em, ArchetypeStorage* from, u32 bit) {
+    ArchetypeStorage** edges = from ? from->add_edges : em->root_edges;
+
+    if (edges[bit]) return edges[bit];
+
+    Archetype archetype = from ? from->archetype : Archetype_Zero;
+    bitmap_set_bit(archetype, bit);
+
+    ArchetypeStorage* to = archetype_storage_get_or_make(em, archetype);
+
+    edges[bit] = to;
+
+    if (from) {
+        to->remove_edges[bit] = from;
+    }
+
+    return to;
+}
+
+ArchetypeStorage* archetype_storage_remove_edge(EntityManager* em, ArchetypeStorage* from, u32 bit) {
+    Assert(from, "Cannot remove a component from the empty archetype.");
+
+    if (from->remove_edges[bit]) return from->remove_edges[bit];
+
+    Archetype archetype = from->archetype;
+    bitmap_clear_bit(archetype, bit);
+
+    if (archetype == Archetype_Zero) return NULL;
+
+    ArchetypeStorage* to = archetype_storage_get_or_make(em, archetype);
+
+    from->remove_edges[bit] = to;
+    to->add_edges[bit]      = from;
+
+    return to;
+}
+
+ArchetypeStorage* archetype_storage_make(Archetype archetype) {
+    ArchetypeStorage* storage = COMPONENTS_MALLOC(ArchetypeStorage, sizeof(ArchetypeStorage));
+    Assert(storage, "Cannot allocate memory for archetype storage");
+
+    storage->archetype     = archetype;
+    storage->chunks        = list_make<u8*>(ARCHETYPE_INITIAL_CHUNKS_LENGTH);
+    storage->spare         = NULL;
+    storage->columns       = COMPONENTS_MALLOC(ArchetypeColumn, sizeof(ArchetypeColumn) * COMPONENTS_COUNT);
+    storage->column_bits   = COMPONENTS_MALLOC(u32, sizeof(u32) * COMPONENTS_COUNT);
+    storage->add_edges     = COMPONENTS_MALLOC(ArchetypeStorage*, sizeof(ArchetypeStorage*) * COMPONENTS_COUNT);
+    storage->remove_edges  = COMPONENTS_MALLOC(ArchetypeStorage*, sizeof(ArchetypeStorage*) * COMPONENTS_COUNT);
+    storage->columns_count = 0;
+    storage->count         = 0;
+
+    Assert(storage->columns, "Cannot allocate memory for archetype columns");
+    Assert(storage->column_bits, "Cannot allocate memory for archetype columns");
+    Assert(storage->add_edges, "Cannot allocate memory for archetype edges");
+    Assert(storage->remove_edges, "Cannot allocate memory for archetype edges");
+
+    memset(storage->columns, 0, sizeof(ArchetypeColumn) * COMPONENTS_COUNT);
+    memset(storage->add_edges, 0, sizeof(ArchetypeStorage*) * COMPONENTS_COUNT);
+    memset(storage->remove_edges, 0, sizeof(ArchetypeStorage*) * COMPONENTS_COUNT);
+
+    u32 row_size = sizeof(Entity);
+
+    for (u32 i : bitmap_bits(archetype)) {
+        ComponentTable* table = get_component_table_by_bit(i);
+
+        if (table->storage != COMPONENT_STORAGE_CHUNK) continue;
+
+        storage->column_bits[storage->columns_count++] = i;
+        storage->columns[i].size = table->component_size;
+        row_size += table->component_size + sizeof(u32);
+    }
+
+    u32 chunk_ticks_size = sizeof(u32) * storage->columns_count;
+
+    // Columns are aligned, so the estimation can overshoot the chunk size by a few rows.
+    u32 capacity = (ARCHETYPE_CHUNK_SIZE - chunk_ticks_size) / row_size;
+
+    for (;;) {
+        Assertf(capacity > 0, "Archetype row (%u B) does not fit into a chunk (%u B).", row_size, ARCHETYPE_CHUNK_SIZE);
+
+        u32 offset = sizeof(Entity) * capacity;
+
+        for (u32 i = 0; i < storage->columns_count; i++) {
+            u32 bit = storage->column_bits[i];
+
+            offset = align_up(offset, ARCHETYPE_COLUMN_ALIGNMENT);
+            storage->columns[bit].offset = offset;
+            offset += storage->columns[bit].size * capacity;
+
+            offset = align_up(offset, sizeof(u32));
+            storage->columns[bit].ticks_offset = offset;
+            offset += sizeof(u32) * capacity;
+        }
+
+        for (u32 i = 0; i < storage->columns_count; i++) {
+            storage->columns[storage->column_bits[i]].chunk_tick_offset = offset + sizeof(u32) * i;
+        }
+
+        offset += chunk_ticks_size;
+
+        if (offset <= ARCHETYPE_CHUNK_SIZE) break;
+
+        capacity--;
+    }
+
+    storage->chunk_capacity = capacity;
+
+    return storage;
+}
+
+void archetype_storage_free(ArchetypeStorage* storage) {
+    Assert(storage, "Cannot free NULL archetype storage.");
+
+    for (u8* chunk : storage->chunks) {
+        COMPONENTS_FREE(chunk);
+    }
+
+    archetype_storage_trim(storage);
+    list_free(&storage->chunks);
+    COMPONENTS_FREE(storage->columns);
+    COMPONENTS_FREE(storage->column_bits);
+    COMPONENTS_FREE(storage->add_edges);
+    COMPONENTS_FREE(storage->remove_edges);
+    COMPONENTS_FREE(storage);
+}
+
+// Empty storages are kept alive, so pointers to them stay valid for the whole lifetime of the manager.
+ArchetypeStorage* archetype_storage_get_or_make(EntityManager* em, Archetype archetype) {
+    ArchetypeStorage* storage = NULL;
+
+    if (table_try_get(&em->archetypes, archetype, &storage)) {
+        return storage;
+    }
+
+    storage = archetype_storage_make(archetype);
+    table_add(&em->archetypes, archetype, storage);
+
+    for (Query* query : em->queries) {
+        if (query_matches(query, archetype)) {
+            list_append(&query->archetypes, storage);
+        }
+    }
+
+    return storage;
+}
+
+// The query is registered in the manager and has to stay at the same address until query_free.
+void query_make(EntityManager* em, Query* query, Archetype with, Archetype without, Archetype optional, Archetype changed) {
+    Assert(query, "Query is null");
+
+    query->with          = with;
+    query->without       = without;
+    query->optional      = optional;
+    query->changed       = changed;
+    query->changed_count = 0;
+    query->sparse_count  = 0;
+    query->defrag        = {};
+    query->archetypes    = list_make<ArchetypeStorage*>();
+    query->range_jobs    = list_make<QueryRangeJob>();
+
+    for (u32 bit : bitmap_bits(changed)) {
+        Assertf(query->changed_count < QUERY_MAX_CHANGED, "Query cannot filter more than %d changed components.", QUERY_MAX_CHANGED);
+        Assertf(get_component_table_by_bit(bit)->storage != COMPONENT_STORAGE_TAG, "Tag %s does not track changes.", Component_Name_By_Bit[bit]);
+        query->changed_bits[query->changed_count++] = bit;
+    }
+
+    // Only the first QUERY_MAX_SPARSE tables are reordered by query_defrag, the query itself works with any number.
+    for (u32 bit : bitmap_bits(bitmap_or(with, optional))) {
+        if (query->sparse_count == QUERY_MAX_SPARSE) break;
+        if (get_component_table_by_bit(bit)->storage != COMPONENT_STORAGE_SPARSE) continue;
+
+        query->sparse_bits[query->sparse_count++] = bit;
+    }
+
+    for (auto [archetype, storage] : em->archetypes) {
+        if (query_matches(query, archetype)) {
+            list_append(&query->archetypes, storage);
+        }
+    }
+
+    list_append(&em->queries, query);
+}
+
+void query_free(EntityManager* em, Query* query) {
+    Assert(query, "Query is null");
+
+    list_remove_swap_back(&em->queries, query);
+    list_free(&query->archetypes);
+    list_free(&query->range_jobs);
+}
+
+// Takes ownership of the sparse tables of the given components and packs the entities, which already have all of them.
+// Iterate it with BEGIN_ITERATE_GROUP_2, the group has to stay at the same address until group_free.
+void group_make(Group* group, Archetype components) {
+    Assert(group, "Group is null");
+
+    group->tables_count = 0;
+    group->count        = 0;
+
+    ComponentTable* smallest = NULL;
+
+    for (u32 bit : bitmap_bits(components)) {
+        ComponentTable* table = get_component_table_by_bit(bit);
+
+        Assertf(group->tables_count < GROUP_MAX_COMPONENTS, "Group cannot own more than %d components.", GROUP_MAX_COMPONENTS);
+        Assertf(table->storage == COMPONENT_STORAGE_SPARSE, "Group can own only sparse components, %s is not.", Component_Name_By_Bit[bit]);
+        Assertf(table->group == NULL, "Component %s is already owned by another group.", Component_Name_By_Bit[bit]);
+
+        group->tables[group->tables_count++] = table;
+
+        if (smallest == NULL || table->dense_count < smallest->dense_count) smallest = table;
+    }
+
+    Assert(group->tables_count >= 2, "Group needs at least two components.");
+
+    for (u32 i = 0; i < group->tables_count; i++) {
+        group->tables[i]->group = group;
+    }
+
+    // Rows before the cursor are visited, a swap only brings an already visited row to the cursor.
+    for (u32 row = 1; row < smallest->dense_count; row++) {
+        group_try_add(group, smallest->entity_by_component_id[row]);
+    }
+}
+
+// Tables keep their order, they are only no longer maintained.
+void group_free(Group* group) {
+    Assert(group, "Group is null");
+
+    for (u32 i = 0; i < group->tables_count; i++) {
+        group->tables[i]->group = NULL;
+    }
+
+    group->tables_count = 0;
+    group->count        = 0;
+}
+
+static inline void query_defrag_restart(QueryDefrag* defrag) {
+    defrag->storage = 0;
+    defrag->chunk   = 0;
+    defrag->row     = 0;
+    defrag->swaps   = 0;
+
+    for (u32 i = 0; i < QUERY_MAX_SPARSE; i++) {
+        defrag->positions[i] = 1; // dense row 0 is never used
+    }
+}
+
+// Reorders the dense rows of the sparse tables used by the query into the query iteration order,
+// so co-iterated tables are walked front to back instead of jumping through the dense arrays.
+// Works for about budget_us microseconds and continues where it stopped on the next call.
+// Returns true once a whole pass found every table in order, later calls start a new pass.
+// Structural changes between calls only cost order, never correctness. Call it at a sync point,
+// it moves rows, so no query may iterate and no component pointers may be held across it.
+// Tables shared by two queries follow whichever query was defragmented last, tables owned by a group are skipped.
+bool query_defrag(Query* query, u64 budget_us) {
+    Assert(query, "Query is null");
+
+    if (query->sparse_count == 0) return true;
+
+    QueryDefrag* defrag = &query->defrag;
+    auto         start  = std::chrono::steady_clock::now();
+    u32          rows   = 0;
+
+    if (defrag->positions[0] == 0) query_defrag_restart(defrag);
+
+    while (true) {
+        if (defrag->storage >= query->archetypes.count) {
+            defrag->sorted = defrag->swaps == 0;
+            query_defrag_restart(defrag);
+
+            // A pass which had to move rows leaves everything in order, unless the tables changed meanwhile.
+            if (defrag->sorted) return true;
+            continue;
+        }
+
+        ArchetypeStorage* storage = query->archetypes.data[defrag->storage];
+
+        if (defrag->chunk >= storage->chunks.count) {
+            defrag->storage++;
+            defrag->chunk = 0;
+            defrag->row   = 0;
+            continue;
+        }
+
+        if (defrag->row >= archetype_storage_chunk_count(storage, defrag->chunk)) {
+            defrag->chunk++;
+            defrag->row = 0;
+            continue;
+        }
+
+        Entity entity = archetype_storage_entities(storage, defrag->chunk)[defrag->row];
+
+        for (u32 i = 0; i < query->sparse_count; i++) {
+            ComponentTable* table = get_component_table_by_bit(query->sparse_bits[i]);
+            u32             id    = component_table_sparse_get(table, entity);
+            u32*            next  = &defrag->positions[i];
+
+            // Optional component, which the entity does not have, or rows removed since the pass began.
+            // Rows of owned tables are ordered by their group.
+            if (id == 0 || *next >= table->dense_count || table->group) continue;
+
+            if (id != *next) {
+                component_table_swap_rows(table, id, *next);
+                defrag->swaps++;
+            }
+
+            (*next)++;
+        }
+
+        defrag->row++;
+
+        if (++rows % QUERY_DEFRAG_CHECK_ROWS == 0) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            if ((u64)elapsed.count() >= budget_us) return false;
+        }
+    }
+}
+
+static void query_range_job(void* data) {
+    QueryRangeJob* job = (QueryRangeJob*)data;
+    job->proc(&job->range, job->data);
+}
+
+// Splits every chunk of the matched archetypes into ranges of at most grain rows and runs them on the job system.
+// Ranges never cross a chunk, so a procedure only sees contiguous columns. Returns when all ranges are done.
+// The procedure must not do structural changes, record them into an EntityCommandBuffer per range instead.
+// MARK_CHANGED is safe inside it, ranges of one chunk or one sparse tick block only share the max tick, which is atomic.
+void query_par_for_each(Query* query, u32 grain, QueryRangeProc proc, void* data) {
+    Assert(query, "Query is null");
+    Assert(proc,  "Query range procedure is null");
+
+    if (grain == 0) grain = 1;
+
+    u32 ranges_count = 0;
+
+    for (ArchetypeStorage* storage : query->archetypes) {
+        for (u32 chunk = 0; chunk < storage->chunks.count; chunk++) {
+            ranges_count += (archetype_storage_chunk_count(storage, chunk) + grain - 1) / grain;
+        }
+    }
+
+    if (ranges_count == 0) return;
+
+    // Jobs point into the list, it only grows before any of them is submitted.
+    if (query->range_jobs.length < ranges_count) list_realloc(&query->range_jobs, ranges_count);
+
+    QueryRangeJob* jobs = query->range_jobs.data;
+
+    u32 index = 0;
+
+    for (ArchetypeStorage* storage : query->archetypes) {
+        for (u32 chunk = 0; chunk < storage->chunks.count; chunk++) {
+            u32 chunk_count = archetype_storage_chunk_count(storage, chunk);
+
+            for (u32 first = 0; first < chunk_count; first += grain) {
+                QueryRangeJob* job = &jobs[index++];
+
+                job->range.storage = storage;
+                job->range.chunk   = chunk;
+                job->range.first   = first;
+                job->range.count   = chunk_count - first < grain ? chunk_count - first : grain;
+                job->proc          = proc;
+                job->data          = data;
+            }
+        }
+    }
+
+    JobCounter counter;
+
+    for (u32 i = 0; i < ranges_count; i++) {
+        jobs_submit({ query_range_job, &jobs[i], &counter });
+    }
+
+    jobs_wait(&counter);
+}
+
+u32 archetype_storage_push(ArchetypeStorage* storage, Entity entity, u32 tick) {
+    u32 row   = storage->count;
+    u32 chunk = row / storage->chunk_capacity;
+    u32 index = row % storage->chunk_capacity;
+
+    if (chunk >= storage->chunks.count) {
+        archetype_storage_append_chunk(storage);
+    }
+
+    archetype_storage_entities(storage, chunk)[index] = entity;
+
+    for (u32 i = 0; i < storage->columns_count; i++) {
+        u32 bit = storage->column_bits[i];
+        memset(archetype_storage_get(storage, row, bit), 0, storage->columns[bit].size);
+        archetype_storage_mark_changed(storage, row, bit, tick);
+    }
+
+    storage->count++;
+
+    return row;
+}
+
+u32 archetype_storage_push_batch(ArchetypeStorage* storage, Entity* entities, u32 count, u32 tick) {
+    u32 first    = storage->count;
+    u32 capacity = storage->chunk_capacity;
+    u32 chunks   = (first + count + capacity - 1) / capacity;
+
+    while (storage->chunks.count < chunks) {
+        archetype_storage_append_chunk(storage);
     }
 
-    list_append(table_get_ptr(&em->archetypes, archetype), entity);
-}
\ No newline at end of file
+    storage->count += count;
+
+    for (u32 row = first; row < first + count;) {
+        u32 chunk = row / capacity;
+        u32 index = row % capacity;
+        u32 run   = min(capacity - index, first + count - row);
+
+        memcpy(archetype_storage_entities(storage, chunk) + index, entities + (row - first), sizeof(Entity) * run);
+
+        for (u32 i = 0; i < storage->columns_count; i++) {
+            u32  bit        = storage->column_bits[i];
+            u32* ticks      = archetype_storage_ticks(storage, chunk, bit) + index;
+            u32* chunk_tick = archetype_storage_chunk_tick(storage, chunk, bit);
+
+            memset(archetype_storage_get(storage, row, bit), 0, storage->columns[bit].size * run);
+
+            for (u32 k = 0; k < run; k++) ticks[k] = tick;
+
+            if (*chunk_tick < tick) *chunk_tick = tick;
+        }
+
+        row += run;
+    }
+
+    return first;
+}
+
+// Copies count tightly packed components into the rows starting at first.
+void archetype_storage_set_rows(ArchetypeStorage* storage, u32 first, u32 count, u32 bit, const void* data, u32 tick) {
+    u32 capacity = storage->chunk_capacity;
+    u32 size     = storage->columns[bit].size;
+
+    Assertf(size != 0, "Component with bit %d is not stored in the archetype chunks.", bit);
+    Assertf(first + count <= storage->count, "Rows %d..%d are outside the bounds of the archetype storage (%d).", first, first + count, storage->count);
+
+    for (u32 row = first; row < first + count;) {
+        u32 run = min(capacity - row % capacity, first + count - row);
+
+        u32  chunk      = row / capacity;
+        u32* ticks      = archetype_storage_ticks(storage, chunk, bit) + row % capacity;
+        u32* chunk_tick = archetype_storage_chunk_tick(storage, chunk, bit);
+
+        memcpy(archetype_storage_get(storage, row, bit), (const u8*)data + (row - first) * size, size * run);
+
+        for (u32 k = 0; k < run; k++) ticks[k] = tick;
+
+        if (*chunk_tick < tick) *chunk_tick = tick;
+
+        row += run;
+    }
+}
+
+// Swaps the last row into the removed one and patches the row of the moved entity.
+void archetype_storage_remove(EntityManager* em, ArchetypeStorage* storage, u32 row) {
+    em->structure_version++;
+
+    Assertf(row < storage->count, "Row (%d) is outside the bounds of the archetype storage (%d).", row, storage->count);
+    u32 last = storage->count - 1;
+
+    if (row != last) {
+        u32    capacity = storage->chunk_capacity;
+        Entity moved    = archetype_storage_entities(storage, last / capacity)[last % capacity];
+
+        archetype_storage_entities(storage, row / capacity)[row % capacity] = moved;
+
+        archetype_storage_copy_row(storage, row, storage, last);
+
+        em->entities[moved].row = row;
+    }
+
+    storage->count--;
+
+    archetype_storage_release_chunks(storage);
+}
+
+// Frees the spare chunk.
+void archetype_storage_trim(ArchetypeStorage* storage) {
+    if (storage->spare == NULL) return;
+
+    COMPONENTS_FREE(storage->spare);
+    storage->spare = NULL;
+}
+
+void ecb_make(EntityCommandBuffer* ecb, EntityManager* em, Allocator* allocator) {
+    Assert(ecb, "Entity command buffer is null");
+
+    ecb->em       = em;
+    ecb->commands = list_make<EntityCommand>(ECB_INITIAL_COMMANDS_LENGTH, allocator);
+    ecb->data     = list_make<u8>(ECB_INITIAL_DATA_LENGTH, allocator);
+}
+
+void ecb_free(EntityCommandBuffer* ecb) {
+    list_free(&ecb->commands);
+    list_free(&ecb->data);
+}
+
+// The id is handed out immediately, it is not stored in any archetype until components are added on playback.
+EntityHandle ecb_create(EntityCommandBuffer* ecb) {
+    return entity_create(ecb->em);
+}
+
+// Adds and sets of components with data must carry the value, playback copies it from data_offset.
+static inline void ecb_push(EntityCommandBuffer* ecb, EntityCommandType type, EntityHandle entity, u32 bit, const void* component) {
+    if (type == ENTITY_COMMAND_ADD || type == ENTITY_COMMAND_SET) {
+        Assertf(component || get_component_table_by_bit(bit)->storage == COMPONENT_STORAGE_TAG,
+                "Command buffer add or set of %s needs the component value.", Component_Name_By_Bit[bit]);
+    }
+
+    EntityCommand command = {
+        .type        = type,
+        .bit         = bit,
+        .data_offset = 0,
+        .entity      = entity,
+    };
+
+    if (component) {
+        u32 size = component_table_value_size(get_component_table_by_bit(bit));
+
+        if (ecb->data.count + size > ecb->data.length) {
+            list_realloc(&ecb->data, max(ecb->data.length * 2, ecb->data.count + size));
+        }
+
+        command.data_offset = ecb->data.count;
+        memcpy(ecb->data.data + ecb->data.count, component, size);
+        ecb->data.count += size;
+    }
+
+    list_append(&ecb->commands, command);
+}
+
+void ecb_destroy(EntityCommandBuffer* ecb, EntityHandle entity) {
+    ecb_push(ecb, ENTITY_COMMAND_DESTROY, entity, 0, NULL);
+}
+
+void ecb_add(EntityCommandBuffer* ecb, EntityHandle entity, u32 bit, const void* component) {
+    ecb_push(ecb, ENTITY_COMMAND_ADD, entity, bit, component);
+}
+
+void ecb_remove(EntityCommandBuffer* ecb, EntityHandle entity, u32 bit) {
+    ecb_push(ecb, ENTITY_COMMAND_REMOVE, entity, bit, NULL);
+}
+
+void ecb_set(EntityCommandBuffer* ecb, EntityHandle entity, u32 bit, const void* component) {
+    ecb_push(ecb, ENTITY_COMMAND_SET, entity, bit, component);
+}
+
+// Commands are sorted by entity and folded into one archetype transition per entity.
+// Transitions are then grouped by target archetype, so every target storage gets its rows reserved once
+// and each entity is moved once, no matter how many components were added or removed.
+void ecb_playback(EntityCommandBuffer* ecb) {
+    EntityManager* em    = ecb->em;
+    u32            count = ecb->commands.count;
+
+    if (count == 0) return;
+
+    EntityCommand* commands         = ecb->commands.data;
+    EntityCommand* commands_scratch = AllocatorAlloc(EntityCommand, Allocator_Temp, sizeof(EntityCommand) * count);
+    EntityChange*  changes          = AllocatorAlloc(EntityChange, Allocator_Temp, sizeof(EntityChange) * count);
+    EntityChange*  changes_scratch  = AllocatorAlloc(EntityChange, Allocator_Temp, sizeof(EntityChange) * count);
+    Entity*        moved            = AllocatorAlloc(Entity, Allocator_Temp, sizeof(Entity) * count);
+    u32            changes_count    = 0;
+
+    Assert(commands_scratch && changes && changes_scratch && moved, "Cannot allocate memory for entity commands playback.");
+
+    merge_sort(commands, commands_scratch, count, [](const EntityCommand& a, const EntityCommand& b) {
+        return a.entity.id < b.entity.id;
+    });
+
+    for (u32 i = 0; i < count;) {
+        u32 end = i + 1;
+
+        while (end < count && commands[end].entity.id == commands[i].entity.id) end++;
+
+        Entity            entity  = commands[i].entity.id;
+        EntityHandle      current = { entity, em->entities[entity].generation };
+        ArchetypeStorage* from    = em->entities[entity].storage;
+        ArchetypeStorage* to      = from;
+        bool              destroy = false;
+
+        for (u32 c = i; c < end; c++) {
+            EntityCommand* command = &commands[c];
+
+            // Commands recorded for an already destroyed entity.
+            if (command->entity.generation != current.generation) continue;
+
+            switch (command->type) {
+                case ENTITY_COMMAND_DESTROY:
+                    destroy = true;
+                break;
+                case ENTITY_COMMAND_ADD:
+                    if (storage_has_bit(to, command->bit) == false) {
+                        to = archetype_storage_add_edge(em, to, command->bit);
+                    }
+                break;
+                case ENTITY_COMMAND_REMOVE:
+                    if (storage_has_bit(to, command->bit)) {
+                        to = archetype_storage_remove_edge(em, to, command->bit);
+                    }
+                break;
+                case ENTITY_COMMAND_SET:
+                break;
+            }
+        }
+
+        if (destroy) {
+            entity_destroy(em, current);
+        } else {
+            changes[changes_count++] = {
+                .entity         = current,
+                .from           = from,
+                .to             = to,
+                .first_command  = i,
+                .commands_count = end - i,
+            };
+        }
+
+        i = end;
+    }
+
+    merge_sort(changes, changes_scratch, changes_count, [](const EntityChange& a, const EntityChange& b) {
+        return (u64)a.to < (u64)b.to;
+    });
+
+    for (u32 i = 0; i < changes_count;) {
+        ArchetypeStorage* to          = changes[i].to;
+        u32               end         = i;
+        u32               moved_count = 0;
+
+        for (; end < changes_count && changes[end].to == to; end++) {
+            EntityChange* change = &changes[end];
+
+            if (change->from == change->to) continue;
+
+            Entity entity = change->entity.id;
+
+            Archetype from_archetype = change->from ? change->from->archetype : Archetype_Zero;
+            Archetype to_archetype   = change->to   ? change->to->archetype   : Archetype_Zero;
+
+            // Only the components, which were added or removed.
+            for (u32 bit : bitmap_bits(bitmap_xor(from_archetype, to_archetype))) {
+                ComponentTable* table = get_component_table_by_bit(bit);
+
+                if (component_table_is_sparse(table) == false) continue;
+
+                if (bitmap_test_bit(from_archetype, bit)) {
+                    component_table_remove(table, entity);
+                } else if (table->storage == COMPONENT_STORAGE_SHARED) {
+                    component_table_add_shared(table, entity, NULL, em->tick);
+                } else {
+                    component_table_add_batch(table, &entity, 1, NULL, em->tick);
+                }
+            }
+
+            moved[moved_count++] = entity;
+        }
+
+        if (to == NULL) {
+            for (u32 k = 0; k < moved_count; k++) {
+                archetype_move_to(em, moved[k], NULL);
+            }
+        } else if (moved_count > 0) {
+            u32 first = archetype_storage_push_batch(to, moved, moved_count, em->tick);
+
+            em->structure_version++;
+
+            for (u32 k = 0; k < moved_count; k++) {
+                EntitySlot*       slot = &em->entities[moved[k]];
+                ArchetypeStorage* from = slot->storage;
+                u32               row  = first + k;
+
+                if (from) {
+                    archetype_storage_copy_row(to, row, from, slot->row);
+                    archetype_storage_remove(em, from, slot->row);
+                }
+
+                slot->archetype = to->archetype;
+                slot->storage   = to;
+                slot->row       = row;
+            }
+        }
+
+        i = end;
+    }
+
+    // Values are written after every move, rows are stable from here on.
+    for (u32 i = 0; i < changes_count; i++) {
+        EntityChange* change = &changes[i];
+        EntitySlot*   slot   = &em->entities[change->entity.id];
+
+        for (u32 c = change->first_command; c < change->first_command + change->commands_count; c++) {
+            EntityCommand* command = &commands[c];
+
+            if (command->type != ENTITY_COMMAND_ADD && command->type != ENTITY_COMMAND_SET) continue;
+            if (command->entity.generation != change->entity.generation) continue;
+            if (storage_has_bit(slot->storage, command->bit) == false) continue;
+
+            ComponentTable* table = get_component_table_by_bit(command->bit);
+            void*           data  = NULL;
+
+            if (table->storage == COMPONENT_STORAGE_TAG) continue;
+
+            if (table->storage == COMPONENT_STORAGE_SHARED) {
+                component_table_set_shared(table, change->entity.id, ecb->data.data + command->data_offset, em->tick);
+                continue;
+            }
+
+            if (table->storage == COMPONENT_STORAGE_CHUNK) {
+                data = archetype_storage_get(slot->storage, slot->row, command->bit);
+                archetype_storage_mark_changed(slot->storage, slot->row, command->bit, em->tick);
+            } else {
+                data = component_table_get_raw(table, change->entity.id);
+                component_table_mark_changed(table, change->entity.id, em->tick);
+            }
+
+            memcpy(data, ecb->data.data + command->data_offset, table->component_size);
+        }
+    }
+
+    list_flush(&ecb->commands);
+    list_flush(&ecb->data);
+}
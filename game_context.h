@@ -5,8 +5,11 @@
 struct Time {
     double  time_double;
     double  dt_double;
+    double  fixed_dt_double; // simulation step, game_update runs with it
     float   time;
-    float   dt;
+    float   dt;              // rendered frame time
+    float   fixed_dt;
+    float   alpha;           // fraction of a simulation step the rendered frame is past the last step
 };
 
 struct Game_Context {
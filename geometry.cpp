@@ -1,10 +1,11 @@
 #include "geometry.h"
 #include "types.h"
+#include "basic.h"
 #include <memory.h>
 #include <cstdlib>
 
-#define Malloc(type, size) (type*)malloc(size)
-#define Free(ptr) free(ptr)
+#define Malloc(type, size) AllocatorAlloc(type, Allocator_Render, size)
+#define Free(ptr) AllocatorFree(Allocator_Render, ptr)
 
 void shape2d_make(Vertex* vertices, u16* indices, u32 vertex_count, u32 index_count, Shape2D* shape) {
     u32   size = sizeof(Vertex) * vertex_count + sizeof(u16) * index_count;
@@ -159,7 +159,8 @@ extern void           glass_get_all_available_fullscreen_params(ScreenParams** b
 extern u64 glass_query_performance_counter();
 extern u64 glass_query_performance_frequency();
 
-extern void glass_sleep(u64 time);
+extern void glass_sleep(u64 time);    // milliseconds
+extern void glass_sleep_ns(u64 time); // nanoseconds, can still oversleep by the OS timer resolution
 
 extern void glass_set_window_title(Window* window, const char* title);
 
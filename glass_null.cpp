@@ -0,0 +1,177 @@
+#include "glass.h"
+#include "glass_null.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "debug.h"
+
+import list;
+
+// Platform layer without a display, input devices or a graphics context.
+// Link it instead of glass_sdl.cpp for servers and simulation only runs, together with render_null.cpp
+// (see build_headless.bat). Windows are only key state nobody presses and the size they were given,
+// there are no fullscreen modes and the main loop never renders.
+
+#define Calloc(type, count) (type*)malloc(sizeof(type) * count)
+
+static List<Window*> Windows;
+static bool          Initialized = false;
+static bool          Should_Quit = false;
+
+Window* glass_create_window(u32 x, u32 y, u32 width, u32 height, const char* name, GlassErrorCode* err) {
+    if (!Initialized) {
+        list_make(&Windows);
+        Initialized = true;
+    }
+
+    Window* window = Calloc(Window, 1);
+
+    if (window == NULL) {
+        *err = GLASS_INTERNAL_ERROR;
+        return NULL;
+    }
+
+    window->keys         = Calloc(KeyState, SCANCODE_COUNT);
+    window->should_close = false;
+    window->params       = {
+        .width        = width,
+        .height       = height,
+        .x            = x,
+        .y            = y,
+        .refresh_rate = 0,
+        .screen_mode  = WINDOWED,
+    };
+
+    memset(window->keys, 0, sizeof(KeyState) * SCANCODE_COUNT);
+
+    list_append(&Windows, window);
+
+    *err = GLASS_OK;
+
+    return window;
+}
+
+void glass_destroy_window(Window* window) {
+    list_remove_swap_back(&Windows, window);
+
+    free(window->keys);
+    free(window);
+
+    if (Windows.count == 0) {
+        Should_Quit = true;
+    }
+}
+
+void glass_destroy_all_windows() {
+    while (Initialized && Windows.count > 0) {
+        glass_destroy_window(Windows.data[Windows.count - 1]);
+    }
+}
+
+void glass_set_window_title(Window* window, const char* title) {
+}
+
+void glass_get_window_size(Window* window, u32* width, u32* height) {
+    *width  = window->params.width;
+    *height = window->params.height;
+}
+
+ScreenParams glass_get_current_screen_params(Window* window) {
+    return window->params;
+}
+
+void glass_set_screen_params(Window* window, ScreenParams params) {
+    bool resized = params.width != window->params.width || params.height != window->params.height;
+    bool moved   = params.x != window->params.x || params.y != window->params.y;
+
+    window->params = params;
+
+    if (resized) glass_on_resize(params.width, params.height);
+    if (moved)   glass_on_move(params.x, params.y);
+}
+
+void glass_set_window_size(Window* window, u32 width, u32 height) {
+    ScreenParams params = window->params;
+
+    params.width  = width;
+    params.height = height;
+
+    glass_set_screen_params(window, params);
+}
+
+u32 glass_get_available_fullscreen_params_count() {
+    return 0;
+}
+
+// There is no display, so there is nothing to write.
+void glass_get_all_available_fullscreen_params(ScreenParams** buffer) {
+}
+
+const char* glass_get_executable_path() {
+    return "./";
+}
+
+bool glass_exit_required() {
+    return Should_Quit;
+}
+
+void glass_main_loop() {
+    glass_game_code();
+}
+
+bool glass_is_button_pressed(Window* win, GlassScancode sc) {
+    return win && win->keys[sc].hold;
+}
+
+u64 glass_query_performance_counter() {
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+u64 glass_query_performance_frequency() {
+    return 1000000000ull;
+}
+
+void glass_sleep(u64 time) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(time));
+}
+
+void glass_sleep_ns(u64 time) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(time));
+}
+
+GlassErrorCode glass_swap_buffers(Window* window) {
+    return GLASS_OK;
+}
+
+// No graphics context, so no function can be loaded.
+void* glass_get_proc_addr(const char* name) {
+    return NULL;
+}
+
+#if defined(WIN32)
+HWND glass_win32_get_window_handle(Window* window) {
+    return NULL;
+}
+
+HINSTANCE glass_win32_get_instance(Window* window) {
+    return GetModuleHandle(NULL);
+}
+#endif
+
+#if defined(Vulkan)
+GlassErrorCode glass_create_vulkan_surface(Window* window, VkInstance vk_instance, VkSurfaceKHR* surface) {
+    return GLASS_RENDER_ERROR;
+}
+
+const char** glass_get_vulkan_instance_extensions(u32* count) {
+    *count = 0;
+    return NULL;
+}
+#endif
+
+u32 get_all_available_mices(InputDevice** mices) {
+    *mices = NULL;
+    return 0;
+}
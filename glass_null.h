@@ -0,0 +1,17 @@
+#pragma once
+
+#include "glass.h"
+
+struct KeyState {
+    bool hold;
+};
+
+union InputDevice {
+    InputDeviceType type;
+};
+
+struct Window {
+    KeyState*    keys;
+    ScreenParams params; // size and position the window was made or last set with
+    bool         should_close;
+};
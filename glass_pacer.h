@@ -0,0 +1,196 @@
+#pragma once
+
+#include <string.h>
+#include "glass.h"
+#include "assert.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define GLASS_PACER_PAUSE() _mm_pause()
+#else
+#define GLASS_PACER_PAUSE()
+#endif
+
+// Frame pacer on top of glass_query_performance_counter. Deadlines are kept in counter ticks and advance by the exact period,
+// so fractional millisecond targets like 144 fps do not drift. Waiting sleeps coarsely with glass_sleep_ns
+// and spins the rest, the spin window grows with the worst oversleep seen and slowly shrinks back.
+//
+// Normal mode waits at the end of the frame, after the swap.
+// Low latency mode waits at the start of the frame instead, until the deadline minus the predicted work time,
+// so input is polled as late as possible and the frame still finishes in time. The prediction is a high percentile
+// of the recent work times, a frame that takes longer than it misses the deadline.
+//
+// Frame and work times are kept as rolling histograms over the last GLASS_PACER_HISTORY frames.
+
+#define GLASS_PACER_HISTORY          256
+#define GLASS_PACER_BUCKETS          128
+#define GLASS_PACER_BUCKET_NS        250000   // the last bucket also collects everything slower
+#define GLASS_PACER_MIN_SPIN_NS      500000
+#define GLASS_PACER_MAX_SPIN_NS      4000000
+#define GLASS_PACER_WORK_PERCENTILE  0.95
+#define GLASS_PACER_WORK_MARGIN_NS   500000
+
+struct GlassPacerHistogram {
+    u64 samples[GLASS_PACER_HISTORY]; // ns, ring buffer
+    u32 buckets[GLASS_PACER_BUCKETS];
+    u32 index;
+    u32 count;
+};
+
+struct GlassPacer {
+    GlassPacerHistogram frames;      // time between two pace points
+    GlassPacerHistogram work;        // begin_frame to end_frame, waits excluded
+    u64                 frequency;
+    u64                 period;      // counter ticks, 0 is unlimited
+    u64                 deadline;    // counter value the running frame should end at
+    u64                 frame_start; // counter value when the running frame started its work
+    u64                 last_pace;   // counter value of the last pace point
+    u64                 frame_ns;    // duration of the last paced frame
+    u64                 spin_ns;
+    u64                 missed;      // frames that ended after their deadline
+    bool                low_latency;
+};
+
+static inline u64 glass_pacer_ticks_to_ns(GlassPacer* pacer, u64 ticks) {
+    return (u64)((double)ticks * 1e9 / (double)pacer->frequency);
+}
+
+static inline u64 glass_pacer_ns_to_ticks(GlassPacer* pacer, u64 ns) {
+    return (u64)((double)ns * (double)pacer->frequency / 1e9);
+}
+
+static inline void glass_pacer_histogram_add(GlassPacerHistogram* histogram, u64 ns) {
+    if (histogram->count == GLASS_PACER_HISTORY) {
+        u64 oldest = histogram->samples[histogram->index];
+        u64 bucket = oldest / GLASS_PACER_BUCKET_NS;
+
+        histogram->buckets[bucket < GLASS_PACER_BUCKETS ? bucket : GLASS_PACER_BUCKETS - 1]--;
+    } else {
+        histogram->count++;
+    }
+
+    u64 bucket = ns / GLASS_PACER_BUCKET_NS;
+
+    histogram->buckets[bucket < GLASS_PACER_BUCKETS ? bucket : GLASS_PACER_BUCKETS - 1]++;
+    histogram->samples[histogram->index] = ns;
+    histogram->index                     = (histogram->index + 1) % GLASS_PACER_HISTORY;
+}
+
+// Upper bound of the bucket holding the percentile, 0 without samples.
+static inline u64 glass_pacer_histogram_percentile(GlassPacerHistogram* histogram, double percentile) {
+    if (histogram->count == 0) return 0;
+
+    u32 rank = (u32)(percentile * (histogram->count - 1)) + 1;
+    u32 seen = 0;
+
+    for (u32 i = 0; i < GLASS_PACER_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+
+        if (seen >= rank) return (u64)(i + 1) * GLASS_PACER_BUCKET_NS;
+    }
+
+    return (u64)GLASS_PACER_BUCKETS * GLASS_PACER_BUCKET_NS;
+}
+
+static inline void glass_pacer_set_target(GlassPacer* pacer, double fps) {
+    u64 period = fps > 0.0 ? (u64)((double)pacer->frequency / fps) : 0;
+
+    if (period == pacer->period) return;
+
+    pacer->period   = period;
+    pacer->deadline = glass_query_performance_counter() + period;
+}
+
+// fps of 0 does not limit the frame rate, only measures it.
+static inline void glass_pacer_make(GlassPacer* pacer, double fps, bool low_latency = false) {
+    memset(pacer, 0, sizeof(GlassPacer));
+
+    pacer->frequency   = glass_query_performance_frequency();
+    pacer->spin_ns     = GLASS_PACER_MIN_SPIN_NS;
+    pacer->low_latency = low_latency;
+    pacer->last_pace   = glass_query_performance_counter();
+    pacer->frame_start = pacer->last_pace;
+
+    glass_pacer_set_target(pacer, fps);
+}
+
+// Sleeps while the sleep cannot overshoot the spin window, then spins on the counter.
+static inline void glass_pacer_wait_until(GlassPacer* pacer, u64 target) {
+    u64 now = glass_query_performance_counter();
+
+    if (now >= target) return;
+
+    u64 remaining_ns = glass_pacer_ticks_to_ns(pacer, target - now);
+
+    if (remaining_ns > pacer->spin_ns) {
+        u64 sleep_ns = remaining_ns - pacer->spin_ns;
+
+        glass_sleep_ns(sleep_ns);
+
+        u64 after    = glass_query_performance_counter();
+        u64 slept_ns = glass_pacer_ticks_to_ns(pacer, after - now);
+        u64 over_ns  = slept_ns > sleep_ns ? slept_ns - sleep_ns : 0;
+
+        // Grow right away so the next wait does not miss, shrink by 1/64 per wait once the timer behaves.
+        if (over_ns + GLASS_PACER_MIN_SPIN_NS / 2 > pacer->spin_ns) {
+            pacer->spin_ns = over_ns + GLASS_PACER_MIN_SPIN_NS / 2;
+        } else {
+            pacer->spin_ns -= (pacer->spin_ns - GLASS_PACER_MIN_SPIN_NS) / 64;
+        }
+
+        if (pacer->spin_ns > GLASS_PACER_MAX_SPIN_NS) pacer->spin_ns = GLASS_PACER_MAX_SPIN_NS;
+    }
+
+    while (glass_query_performance_counter() < target) {
+        GLASS_PACER_PAUSE();
+    }
+}
+
+static inline void glass_pacer_pace_point(GlassPacer* pacer) {
+    u64 now = glass_query_performance_counter();
+
+    pacer->frame_ns  = glass_pacer_ticks_to_ns(pacer, now - pacer->last_pace);
+    pacer->last_pace = now;
+
+    glass_pacer_histogram_add(&pacer->frames, pacer->frame_ns);
+}
+
+// Call it before polling input. In low latency mode it waits here.
+static inline void glass_pacer_begin_frame(GlassPacer* pacer) {
+    if (pacer->low_latency && pacer->period > 0) {
+        u64 work_ns = glass_pacer_histogram_percentile(&pacer->work, GLASS_PACER_WORK_PERCENTILE) + GLASS_PACER_WORK_MARGIN_NS;
+        u64 work    = glass_pacer_ns_to_ticks(pacer, work_ns);
+
+        if (pacer->deadline > work) glass_pacer_wait_until(pacer, pacer->deadline - work);
+
+        glass_pacer_pace_point(pacer);
+    }
+
+    pacer->frame_start = glass_query_performance_counter();
+}
+
+// Call it after the swap. In normal mode it waits here.
+static inline void glass_pacer_end_frame(GlassPacer* pacer) {
+    u64 now = glass_query_performance_counter();
+
+    glass_pacer_histogram_add(&pacer->work, glass_pacer_ticks_to_ns(pacer, now - pacer->frame_start));
+
+    if (pacer->period == 0) {
+        glass_pacer_pace_point(pacer);
+        return;
+    }
+
+    if (now > pacer->deadline) pacer->missed++;
+
+    if (pacer->low_latency == false) {
+        glass_pacer_wait_until(pacer, pacer->deadline);
+        glass_pacer_pace_point(pacer);
+    }
+
+    pacer->deadline += pacer->period;
+
+    // More than a whole frame late, start a new cadence instead of rushing the next frames to catch up.
+    now = glass_query_performance_counter();
+
+    if (pacer->deadline < now) pacer->deadline = now + pacer->period;
+}
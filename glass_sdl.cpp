@@ -153,6 +153,10 @@ void glass_sleep(u64 time) {
     SDL_Delay(time);
 }
 
+void glass_sleep_ns(u64 time) {
+    SDL_DelayNS(time);
+}
+
 GlassErrorCode glass_swap_buffers(Window* window) {
 #ifdef GLASS_OPENGL
     SDL_GL_SwapWindow(window->window);
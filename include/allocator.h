@@ -1,6 +1,7 @@
 #pragma once
 
 #include "types.h"
+#include "memory_debug.h"
 
 #define AllocatorAlloc(type, allocator, size) (type*)(allocator)->alloc(size)
 #define AllocatorCalloc(type, allocator, count) (type*)(allocator)->alloc(sizeof(type) * (count))
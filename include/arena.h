@@ -1,10 +1,16 @@
 #pragma once
 
+#include <string.h>
+#include <stdint.h>
 #include "types.h"
 #include "allocator.h"
 #include "assert.h"
 
 #ifdef ARENA_CUSTOM_MALLOC
+#elif defined(MEMORY_DEBUG)
+    #define Arena_Malloc(type, size)       (type*)memory_alloc(size, MEMORY_TAG_TEMP)
+    #define Arena_Realloc(type, ptr, size) (type*)memory_realloc(ptr, size, MEMORY_TAG_TEMP)
+    #define Arena_Free(ptr)                       memory_free(ptr)
 #else
     #include "malloc.h"
     #define Arena_Malloc(type, size)       (type*)malloc(size)
@@ -12,17 +18,43 @@
     #define Arena_Free(ptr)                       free(ptr)
 #endif
 
-#define ARENA_BUCKET_SIZE 1024 * 1024 * 8
+// Bump allocator over a chain of buckets. Allocations go into the current bucket, buckets after it are empty,
+// so an allocation never walks the chain unless the current bucket is full.
+// The last allocation grows and shrinks in place, any other realloc copies.
+// arena_mark/arena_rewind (or ARENA_SCOPE) free everything allocated after the mark.
+//
+// On clear buckets unused for ARENA_RELEASE_AFTER clears are freed, so a spike does not keep its memory forever,
+// and if the first bucket overflowed ARENA_MERGE_AFTER clears in a row the used buckets are merged into one.
+
+#define ARENA_BUCKET_SIZE       (1024 * 1024 * 8)
+#define ARENA_DEFAULT_ALIGNMENT 16  // like malloc, enough for Matrix4 and SSE loads
+#define ARENA_RELEASE_AFTER     120 // clears
+#define ARENA_MERGE_AFTER       8   // clears
+
+#define ARENA_CONCAT_(a, b) a##b
+#define ARENA_CONCAT(a, b)  ARENA_CONCAT_(a, b)
 
 struct ArenaBucket {
     ArenaBucket* next;
-    u8*          data;
+    u8*          data;      // right after the bucket header
     u64          capacity;
     u64          allocated;
+    u32          idle;      // clears in a row the bucket stayed empty
+};
+
+struct ArenaMark {
+    ArenaBucket* bucket;
+    u64          allocated;
+#ifdef MEMORY_DEBUG
+    u64          total_allocated;
+#endif
 };
 
 struct Arena : public Allocator {
     ArenaBucket* start;
+    ArenaBucket* current;
+    u8*          last;      // start of the last allocation, NULL after a clear or rewind
+    u32          overflows; // clears in a row that found more than the first bucket used
 #ifdef MEMORY_DEBUG
     u64          total_capacity;
     u64          allocated;
@@ -35,109 +67,241 @@ struct Arena : public Allocator {
     void  clear() override;
 };
 
-static inline ArenaBucket* arena_bucket_make(u64 capacity);
-static inline void         arena_bucket_free(ArenaBucket* bucket);
-static inline void         arena_bucket_clear(ArenaBucket* bucket);
-static inline ArenaBucket* arena_get_fit_bucket(Arena* arena, u64 size);
+static inline ArenaBucket* arena_bucket_make(Arena* arena, u64 capacity);
+static inline void         arena_bucket_free(Arena* arena, ArenaBucket* bucket);
+static inline void*        arena_alloc(Arena* arena, u64 size, u64 alignment = ARENA_DEFAULT_ALIGNMENT);
+static inline void         arena_clear(Arena* arena);
+static inline ArenaMark    arena_mark(Arena* arena);
+static inline void         arena_rewind(Arena* arena, ArenaMark mark);
 
 inline Arena::Arena() {
-    start = arena_bucket_make(ARENA_BUCKET_SIZE);
-
 #ifdef MEMORY_DEBUG
-    total_capacity = ARENA_BUCKET_SIZE;
+    total_capacity = 0;
     allocated      = 0;
-    buckets_count  = 1;
+    buckets_count  = 0;
 #endif
+    start     = arena_bucket_make(this, ARENA_BUCKET_SIZE);
+    current   = start;
+    last      = NULL;
+    overflows = 0;
 }
 
 inline Arena::~Arena() {
-    arena_bucket_free(start);
+    arena_bucket_free(this, start);
 }
 
 inline void* Arena::alloc(u64 size) {
-    ArenaBucket* bucket = arena_get_fit_bucket(this, size);
-    
-    u64 offset = bucket->allocated;
+    return arena_alloc(this, size);
+}
+
+inline void* Arena::realloc(void* ptr, u64 size) {
+    if (ptr == NULL) return arena_alloc(this, size);
 
-    bucket->allocated += size;
+    u8* block = (u8*)ptr;
 
+    if (block == last) {
+        u64 offset = block - current->data;
+
+        if (offset + size <= current->capacity) {
 #ifdef MEMORY_DEBUG
-    allocated += size;
+            allocated += size - (current->allocated - offset);
 #endif
-    
-    return (void*)(bucket->data + offset);
+            current->allocated = offset + size;
+            return ptr;
+        }
+    }
+
+    // The old size is unknown, everything up to the end of the used part of its bucket is copied, which covers the block.
+    u64 available = 0;
+
+    for (ArenaBucket* bucket = start; bucket != current->next; bucket = bucket->next) {
+        if (block >= bucket->data && block < bucket->data + bucket->allocated) {
+            available = bucket->data + bucket->allocated - block;
+            break;
+        }
+    }
+
+    Assert(available > 0, "Cannot realloc a block, which is not in the used part of the arena.");
+
+    void* data = arena_alloc(this, size);
+
+    memcpy(data, ptr, available < size ? available : size);
+
+    return data;
 }
 
-inline void* Arena::realloc(void* ptr, u64 size) {
-    ArenaBucket* bucket = arena_get_fit_bucket(this, size);
-    
-    u64 offset = bucket->allocated;
+inline void Arena::clear() {
+    arena_clear(this);
+}
+
+// The bucket header and its data are one allocation.
+static inline ArenaBucket* arena_bucket_make(Arena* arena, u64 capacity) {
+    (void)arena;
 
-    bucket->allocated += size;
+    ArenaBucket* bucket = Arena_Malloc(ArenaBucket, sizeof(ArenaBucket) + capacity);
+
+    Assertf(bucket, "Not enough memory for arena bucket. Wanted capacity: %llu", capacity);
+
+    bucket->next      = NULL;
+    bucket->data      = (u8*)(bucket + 1);
+    bucket->capacity  = capacity;
+    bucket->allocated = 0;
+    bucket->idle      = 0;
 
 #ifdef MEMORY_DEBUG
-    allocated += size;
+    arena->total_capacity += capacity;
+    arena->buckets_count++;
 #endif
-    
-    return (void*)(bucket->data + offset);
+
+    return bucket;
 }
 
-inline void Arena::clear() {
-    arena_bucket_clear(start);
+// Frees the bucket and every bucket after it.
+static inline void arena_bucket_free(Arena* arena, ArenaBucket* bucket) {
+    (void)arena;
+
+    while (bucket) {
+        ArenaBucket* next = bucket->next;
+
 #ifdef MEMORY_DEBUG
-    allocated = 0;
+        arena->total_capacity -= bucket->capacity;
+        arena->buckets_count--;
 #endif
+
+        Arena_Free(bucket);
+        bucket = next;
+    }
 }
 
-static inline ArenaBucket* arena_bucket_make(u64 capacity) {
-    ArenaBucket* bucket = Arena_Malloc(ArenaBucket, sizeof(ArenaBucket));
+// Offset inside the bucket where a block with the alignment can start.
+static inline u64 arena_aligned_offset(ArenaBucket* bucket, u64 alignment) {
+    uintptr_t address = (uintptr_t)(bucket->data + bucket->allocated);
+    uintptr_t aligned = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
 
-    Assert(bucket, "Not enough memory for arena bucket");
-    
-    bucket->allocated = 0;
-    bucket->capacity  = capacity;
-    bucket->data      = Arena_Malloc(u8, capacity);
-    bucket->next      = NULL;
+    return aligned - (uintptr_t)bucket->data;
+}
 
-    Assertf(bucket->data, "Not enough memory for arena data. Wanted capacity: %llu", capacity);
+static inline void* arena_alloc(Arena* arena, u64 size, u64 alignment) {
+    Assert(alignment > 0 && (alignment & (alignment - 1)) == 0, "Arena alignment must be a power of two.");
 
-    return bucket;
+    ArenaBucket* bucket = arena->current;
+
+    while (true) {
+        u64 offset = arena_aligned_offset(bucket, alignment);
+
+        if (offset + size <= bucket->capacity) {
+            bucket->allocated = offset + size;
+            arena->current    = bucket;
+            arena->last       = bucket->data + offset;
+
+#ifdef MEMORY_DEBUG
+            arena->allocated += size;
+#endif
+
+            return arena->last;
+        }
+
+        // The rest of a full bucket stays unused until the next clear or rewind.
+        if (bucket->next == NULL) {
+            u64 capacity = size + alignment > ARENA_BUCKET_SIZE ? size + alignment : ARENA_BUCKET_SIZE;
+            bucket->next = arena_bucket_make(arena, capacity);
+        }
+
+        bucket = bucket->next;
+    }
 }
 
-static inline void arena_bucket_free(ArenaBucket* bucket) {
-    if (bucket->next) {
-        arena_bucket_free(bucket->next);
+static inline void arena_clear(Arena* arena) {
+    arena->overflows = arena->current != arena->start ? arena->overflows + 1 : 0;
+
+    // Frames keep spilling out of the first bucket, replace the used buckets with one that fits all of them.
+    if (arena->overflows >= ARENA_MERGE_AFTER) {
+        u64          capacity = 0;
+        ArenaBucket* rest     = arena->current->next;
+
+        for (ArenaBucket* bucket = arena->start; bucket != rest; bucket = bucket->next) {
+            capacity += bucket->capacity;
+        }
+
+        arena->current->next = NULL;
+        arena_bucket_free(arena, arena->start);
+
+        arena->start       = arena_bucket_make(arena, capacity);
+        arena->start->next = rest;
+        arena->current     = arena->start;
+        arena->overflows   = 0;
     }
 
-    Arena_Free(bucket);
-}
+    for (ArenaBucket* bucket = arena->start; bucket; bucket = bucket->next) {
+        bucket->idle      = bucket->allocated > 0 ? 0 : bucket->idle + 1;
+        bucket->allocated = 0;
+    }
 
-static inline void arena_bucket_clear(ArenaBucket* bucket) {
-    bucket->allocated = 0;
+    // The first bucket is always kept.
+    for (ArenaBucket* bucket = arena->start; bucket->next;) {
+        ArenaBucket* next = bucket->next;
+
+        if (next->idle < ARENA_RELEASE_AFTER) {
+            bucket = next;
+            continue;
+        }
 
-    if (bucket->next) {
-        arena_bucket_clear(bucket->next);
+        bucket->next = next->next;
+        next->next   = NULL;
+        arena_bucket_free(arena, next);
     }
+
+    arena->current = arena->start;
+    arena->last    = NULL;
+
+#ifdef MEMORY_DEBUG
+    arena->allocated = 0;
+#endif
+}
+
+// A block from before the mark must not grow in place past it, the rewind would cut it, so last is forgotten.
+static inline ArenaMark arena_mark(Arena* arena) {
+    arena->last = NULL;
+
+    ArenaMark mark = {
+        .bucket          = arena->current,
+        .allocated       = arena->current->allocated,
+#ifdef MEMORY_DEBUG
+        .total_allocated = arena->allocated,
+#endif
+    };
+
+    return mark;
 }
 
-static inline ArenaBucket* arena_get_fit_bucket(Arena* arena, u64 size) {
-    ArenaBucket* start = arena->start;
+// Everything allocated after the mark is freed, the mark must be taken after the last clear.
+static inline void arena_rewind(Arena* arena, ArenaMark mark) {
+    for (ArenaBucket* bucket = mark.bucket->next; bucket != arena->current->next; bucket = bucket->next) {
+        bucket->allocated = 0;
+    }
 
-    while((start->allocated + size) > start->capacity) {
-        if (!start->next) {
-            u64 capacity = size > ARENA_BUCKET_SIZE ? size : ARENA_BUCKET_SIZE;
-            start->next = arena_bucket_make(capacity);
+    mark.bucket->allocated = mark.allocated;
+    arena->current         = mark.bucket;
+    arena->last            = NULL;
 
 #ifdef MEMORY_DEBUG
-            arena->buckets_count++;
-            arena->total_capacity += size;
+    arena->allocated = mark.total_allocated;
 #endif
+}
 
-            Assertf(start->next, "Cannot allocate arena bucket with size %llu.", size);
-        }
-        
-        start = start->next;
+// Rewinds the arena at the end of the scope.
+struct ArenaScope {
+    Arena*    arena;
+    ArenaMark mark;
+
+    ArenaScope(Arena* scope_arena) {
+        arena = scope_arena;
+        mark  = arena_mark(scope_arena);
     }
 
-    return start;
-}
\ No newline at end of file
+    ~ArenaScope() {
+        arena_rewind(arena, mark);
+    }
+};
+
+#define ARENA_SCOPE(arena) ArenaScope ARENA_CONCAT(arena_scope_, __LINE__)(arena)
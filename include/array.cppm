@@ -69,18 +69,7 @@ void
 array_realloc(Array<T>* array, u64 length) {
     Assert(array->data, "Cannot realloc uninitialized array, initialize it with array_make.");
     Assert(length > array->length, "Cannot resize array with less size.");
-    if (array->allocator == Allocator_Temp) {
-        T* new_data = AllocatorAlloc(T, array->allocator, sizeof(T) * length);
-        Assert(new_data, "Cannot allocate enough memory for new array");
-
-        for (u64 i = 0; i < array->length; i++) {
-            new_data[i] = array->data[i];
-        }
-
-        array->data = new_data;
-    } else {
-        array->data = (T*)array->allocator->realloc(array->data, sizeof(T) * length);
-    }
+    array->data = (T*)array->allocator->realloc(array->data, sizeof(T) * length);
 
     Assert(array->data, "Cannot realloc array");
     array->length = length;
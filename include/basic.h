@@ -5,6 +5,8 @@
 #define null NULL
 
 extern Allocator* Allocator_Persistent;
+extern Allocator* Allocator_Text      ;
+extern Allocator* Allocator_Render    ;
 extern Allocator* Allocator_Temp      ;
 
 static inline
@@ -4,6 +4,19 @@ module;
 #include "assert.h"
 #include "debug.h"
 #include "stdio.h"
+#include "hash_functions.h"
+
+#if defined(__AVX2__)
+#define BITMAP_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BITMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
 
 export module bitmap;
 
@@ -18,16 +31,69 @@ struct Bitmap {
 };
 
 
+// Bitmaps are processed 256 bits at a time with AVX2, 128 bits with SSE2, what is left slot by slot.
+// Every wide op folds its lanes into one register and tests it once at the end, so there is no branch per lane.
+#define BITMAP_SLOTS (bit_count / BITS_PER_SLOT)
+
+inline u32 bitmap_ctz(u64 value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctzll(value);
+#endif
+}
+
+// Set bits in ascending order, the iterator clears the lowest bit of the current slot and skips empty slots.
+// The range keeps a copy of the bitmap, so bitmap_bits(bitmap_and(a, b)) is safe to iterate.
 BITMAP_TEMPLATE
-inline u64 get_hash(Bitmap<bit_count> bitmap) {
-    u32 count = bit_count / BITS_PER_SLOT;
-    u64 total = 0;
+struct BitmapBitIterator {
+    const u64* bits;
+    u32        slot;
+    u64        word; // bits of the slot, which were not visited yet
 
-    for (u32 i = 0; i < count; i++) {
-        total += bitmap.bits[i];
+    u32 operator*() const {
+        return slot * BITS_PER_SLOT + bitmap_ctz(word);
     }
 
-    return total;
+    BitmapBitIterator& operator++() {
+        word &= word - 1;
+
+        while (word == 0 && ++slot < BITMAP_SLOTS) {
+            word = bits[slot];
+        }
+
+        return *this;
+    }
+
+    bool operator!=(const BitmapBitIterator& other) const {
+        return slot != other.slot || word != other.word;
+    }
+};
+
+BITMAP_TEMPLATE
+struct BitmapBits {
+    u64 bits[BITMAP_SLOTS];
+
+    BitmapBitIterator<bit_count> begin() const {
+        BitmapBitIterator<bit_count> it = { bits, 0, bits[0] };
+
+        while (it.word == 0 && ++it.slot < BITMAP_SLOTS) {
+            it.word = bits[it.slot];
+        }
+
+        return it;
+    }
+
+    BitmapBitIterator<bit_count> end() const {
+        return { bits, BITMAP_SLOTS, 0 };
+    }
+};
+
+BITMAP_TEMPLATE
+inline u64 get_hash(Bitmap<bit_count> bitmap) {
+    return hash_bytes(bitmap.bits, sizeof(bitmap.bits));
 }
 
 
@@ -44,15 +110,36 @@ inline Bitmap<bit_count> bitmap_make(Args... args) {
 
 BITMAP_TEMPLATE
 inline bool operator==(const Bitmap<bit_count> lhs, const Bitmap<bit_count> rhs) {
-    u32 count = bit_count / BITS_PER_SLOT;
+    u32 i = 0;
+    u64 diff = 0;
 
-    for (u32 i = 0; i < count; i++) {
-        if (lhs.bits[i] != rhs.bits[i]) {
-            return false;
-        }
+#if defined(BITMAP_AVX2)
+    __m256i wide = _mm256_setzero_si256();
+
+    for (; i + 4 <= BITMAP_SLOTS; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)&lhs.bits[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&rhs.bits[i]);
+        wide = _mm256_or_si256(wide, _mm256_xor_si256(a, b));
+    }
+
+    if (_mm256_testz_si256(wide, wide) == 0) return false;
+#elif defined(BITMAP_SSE2)
+    __m128i wide = _mm_setzero_si128();
+
+    for (; i + 2 <= BITMAP_SLOTS; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&lhs.bits[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&rhs.bits[i]);
+        wide = _mm_or_si128(wide, _mm_xor_si128(a, b));
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(wide, _mm_setzero_si128())) != 0xFFFF) return false;
+#endif
+
+    for (; i < BITMAP_SLOTS; i++) {
+        diff |= lhs.bits[i] ^ rhs.bits[i];
     }
 
-    return true;
+    return diff == 0;
 }
 
 BITMAP_TEMPLATE
@@ -114,18 +201,135 @@ inline void bitmap_set_all(Bitmap<bit_count>& bitmap) {
     }
 }
 
+// Applies op to every slot, wide_op and narrow_op are the same op on AVX2 and SSE2 registers.
+#if defined(BITMAP_AVX2)
+#define BITMAP_BINARY_OP(res, a, b, op, wide_op, narrow_op) \
+    u32 __i = 0;\
+    for (; __i + 4 <= BITMAP_SLOTS; __i += 4) {\
+        __m256i __a = _mm256_loadu_si256((const __m256i*)&(a).bits[__i]);\
+        __m256i __b = _mm256_loadu_si256((const __m256i*)&(b).bits[__i]);\
+        _mm256_storeu_si256((__m256i*)&(res).bits[__i], wide_op(__a, __b));\
+    }\
+    for (; __i < BITMAP_SLOTS; __i++) (res).bits[__i] = (a).bits[__i] op (b).bits[__i];\
+
+#elif defined(BITMAP_SSE2)
+#define BITMAP_BINARY_OP(res, a, b, op, wide_op, narrow_op) \
+    u32 __i = 0;\
+    for (; __i + 2 <= BITMAP_SLOTS; __i += 2) {\
+        __m128i __a = _mm_loadu_si128((const __m128i*)&(a).bits[__i]);\
+        __m128i __b = _mm_loadu_si128((const __m128i*)&(b).bits[__i]);\
+        _mm_storeu_si128((__m128i*)&(res).bits[__i], narrow_op(__a, __b));\
+    }\
+    for (; __i < BITMAP_SLOTS; __i++) (res).bits[__i] = (a).bits[__i] op (b).bits[__i];\
+
+#else
+#define BITMAP_BINARY_OP(res, a, b, op, wide_op, narrow_op) \
+    for (u32 __i = 0; __i < BITMAP_SLOTS; __i++) (res).bits[__i] = (a).bits[__i] op (b).bits[__i];\
+
+#endif
+
 BITMAP_TEMPLATE
-inline Bitmap<bit_count> bitmap_and(Bitmap<bit_count>& a, Bitmap<bit_count>& b) {
+inline Bitmap<bit_count> bitmap_and(const Bitmap<bit_count>& a, const Bitmap<bit_count>& b) {
     Bitmap<bit_count> res;
-    u32 count = bit_count / BITS_PER_SLOT;
+    BITMAP_BINARY_OP(res, a, b, &, _mm256_and_si256, _mm_and_si128)
+    return res;
+}
 
-    for (u32 i = 0; i < count; i++) {
-        res.bits[i] = a.bits[i] & b.bits[i];
-    }
+BITMAP_TEMPLATE
+inline Bitmap<bit_count> bitmap_or(const Bitmap<bit_count>& a, const Bitmap<bit_count>& b) {
+    Bitmap<bit_count> res;
+    BITMAP_BINARY_OP(res, a, b, |, _mm256_or_si256, _mm_or_si128)
+    return res;
+}
 
+BITMAP_TEMPLATE
+inline Bitmap<bit_count> bitmap_xor(const Bitmap<bit_count>& a, const Bitmap<bit_count>& b) {
+    Bitmap<bit_count> res;
+    BITMAP_BINARY_OP(res, a, b, ^, _mm256_xor_si256, _mm_xor_si128)
     return res;
 }
 
+// True if every bit of subset is set in bitmap, the archetype test of a query.
+BITMAP_TEMPLATE
+inline bool bitmap_contains(const Bitmap<bit_count>& bitmap, const Bitmap<bit_count>& subset) {
+    u32 i       = 0;
+    u64 missing = 0;
+
+#if defined(BITMAP_AVX2)
+    __m256i wide = _mm256_setzero_si256();
+
+    for (; i + 4 <= BITMAP_SLOTS; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)&bitmap.bits[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&subset.bits[i]);
+        wide = _mm256_or_si256(wide, _mm256_andnot_si256(a, b));
+    }
+
+    if (_mm256_testz_si256(wide, wide) == 0) return false;
+#elif defined(BITMAP_SSE2)
+    __m128i wide = _mm_setzero_si128();
+
+    for (; i + 2 <= BITMAP_SLOTS; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)&bitmap.bits[i]);
+        __m128i b = _mm_loadu_si128((const __m128i*)&subset.bits[i]);
+        wide = _mm_or_si128(wide, _mm_andnot_si128(a, b));
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(wide, _mm_setzero_si128())) != 0xFFFF) return false;
+#endif
+
+    for (; i < BITMAP_SLOTS; i++) {
+        missing |= subset.bits[i] & ~bitmap.bits[i];
+    }
+
+    return missing == 0;
+}
+
+// True if any bit is set in both.
+BITMAP_TEMPLATE
+inline bool bitmap_intersects(const Bitmap<bit_count>& a, const Bitmap<bit_count>& b) {
+    u32 i      = 0;
+    u64 common = 0;
+
+#if defined(BITMAP_AVX2)
+    __m256i wide = _mm256_setzero_si256();
+
+    for (; i + 4 <= BITMAP_SLOTS; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)&a.bits[i]);
+        __m256i y = _mm256_loadu_si256((const __m256i*)&b.bits[i]);
+        wide = _mm256_or_si256(wide, _mm256_and_si256(x, y));
+    }
+
+    if (_mm256_testz_si256(wide, wide) == 0) return true;
+#elif defined(BITMAP_SSE2)
+    __m128i wide = _mm_setzero_si128();
+
+    for (; i + 2 <= BITMAP_SLOTS; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)&a.bits[i]);
+        __m128i y = _mm_loadu_si128((const __m128i*)&b.bits[i]);
+        wide = _mm_or_si128(wide, _mm_and_si128(x, y));
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(wide, _mm_setzero_si128())) != 0xFFFF) return true;
+#endif
+
+    for (; i < BITMAP_SLOTS; i++) {
+        common |= a.bits[i] & b.bits[i];
+    }
+
+    return common != 0;
+}
+
+BITMAP_TEMPLATE
+inline BitmapBits<bit_count> bitmap_bits(const Bitmap<bit_count>& bitmap) {
+    BitmapBits<bit_count> range;
+
+    for (u32 i = 0; i < BITMAP_SLOTS; i++) {
+        range.bits[i] = bitmap.bits[i];
+    }
+
+    return range;
+}
+
 BITMAP_TEMPLATE
 inline void bitmap_print(const Bitmap<bit_count>& bitmap) {
     // printf("Bitmap [%u]: ", bit_count);
@@ -1,67 +1,141 @@
 #pragma once
 
-inline
-u64
-get_hash(u8 i) {
-    return 1 + i ^ 33;
-}
+#include "types.h"
+#include <string.h>
 
-inline
-u64
-get_hash(s8 i) {
-    return 1 + i ^ 33;
-}
+#if defined(_MSC_VER) && !defined(__clang__) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// wyhash style hashing. Every input goes through at least one 64x64->128 multiply folded back to 64 bits,
+// so a one bit change in the key flips about half of the hash bits (HashTable uses both the low 7 bits and the high bits).
 
+#define HASH_SECRET_0 0xa0761d6478bd642full
+#define HASH_SECRET_1 0xe7037ed1a0b428dbull
+#define HASH_SECRET_2 0x8ebc6af09c88c6e3ull
+#define HASH_SECRET_3 0x589965cc75374cc3ull
+
+// Full 128 bit product of a and b, low half into a, high half into b.
 inline
-u64
-get_hash(u16 i) {
-    return 1 + i ^ 234656;
+void
+hash_mum128(u64* a, u64* b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+    u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    u64 t  = rl + (rm0 << 32);
+    u64 c  = t < rl;
+    u64 lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
 }
 
 inline
 u64
-get_hash(s16 i) {
-    return 1 + i ^ 982374;
+hash_mum(u64 a, u64 b) {
+    hash_mum128(&a, &b);
+    return a ^ b;
 }
 
 inline
 u64
-get_hash(u32 i) {
-    return 1 + i ^ 109238123;
+hash_read64(const u8* p) {
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
 inline
 u64
-get_hash(s32 i) {
-    return 1 + i ^ 98672453;
+hash_read32(const u8* p) {
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
 inline
 u64
-get_hash(u64 i) {
-    return 1 + i ^ 17862943124;
+hash_u64(u64 value) {
+    return hash_mum(hash_mum(value ^ HASH_SECRET_0, value ^ HASH_SECRET_1) ^ HASH_SECRET_2, HASH_SECRET_3);
 }
 
+// Length aware, does not need a terminator and hashes embedded zeros.
 inline
 u64
-get_hash(s64 i) {
-    return 1 + i ^ 9875612353;
-}
+hash_bytes(const void* data, u64 length, u64 seed = 0) {
+    const u8* p = (const u8*)data;
+    u64       a = 0;
+    u64       b = 0;
 
-inline
-u64 get_hash(char* str) {
-    u64 hash = 5381;
-    s32 c;
+    seed ^= hash_mum(seed ^ HASH_SECRET_0, HASH_SECRET_1);
+
+    if (length <= 16) {
+        if (length >= 4) {
+            u64 shift = (length >> 3) << 2;
 
-    while((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
+            a = (hash_read32(p) << 32) | hash_read32(p + shift);
+            b = (hash_read32(p + length - 4) << 32) | hash_read32(p + length - 4 - shift);
+        } else if (length > 0) {
+            a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 8) | p[length - 1];
+        }
+    } else {
+        u64 left = length;
+
+        if (left > 48) {
+            u64 seed1 = seed;
+            u64 seed2 = seed;
+
+            do {
+                seed  = hash_mum(hash_read64(p)      ^ HASH_SECRET_1, hash_read64(p + 8)  ^ seed);
+                seed1 = hash_mum(hash_read64(p + 16) ^ HASH_SECRET_2, hash_read64(p + 24) ^ seed1);
+                seed2 = hash_mum(hash_read64(p + 32) ^ HASH_SECRET_3, hash_read64(p + 40) ^ seed2);
+                p    += 48;
+                left -= 48;
+            } while (left > 48);
+
+            seed ^= seed1 ^ seed2;
+        }
+
+        while (left > 16) {
+            seed  = hash_mum(hash_read64(p) ^ HASH_SECRET_1, hash_read64(p + 8) ^ seed);
+            p    += 16;
+            left -= 16;
+        }
+
+        a = hash_read64(p + left - 16);
+        b = hash_read64(p + left - 8);
     }
 
-    return hash;
+    a ^= HASH_SECRET_1;
+    b ^= seed;
+    hash_mum128(&a, &b);
+
+    return hash_mum(a ^ HASH_SECRET_0 ^ length, b ^ HASH_SECRET_1);
+}
+
+inline u64 get_hash(u8  i) { return hash_u64(i); }
+inline u64 get_hash(s8  i) { return hash_u64((u64)i); }
+inline u64 get_hash(u16 i) { return hash_u64(i); }
+inline u64 get_hash(s16 i) { return hash_u64((u64)i); }
+inline u64 get_hash(u32 i) { return hash_u64(i); }
+inline u64 get_hash(s32 i) { return hash_u64((u64)i); }
+inline u64 get_hash(u64 i) { return hash_u64(i); }
+inline u64 get_hash(s64 i) { return hash_u64((u64)i); }
+
+inline
+u64 get_hash(char* str) {
+    return hash_bytes(str, strlen(str));
 }
 
 template <typename T>
 inline
 u64 get_hash(T* ptr) {
-    return (u64)ptr;
-}
\ No newline at end of file
+    return hash_u64((u64)ptr);
+}
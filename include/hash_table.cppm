@@ -7,11 +7,35 @@ module;
 #include "hash_functions.h"
 #include "debug.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HASH_TABLE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define HASH_TABLE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 export module hash_table;
 
+import math;
+
+// Open addressing with a separate array of control bytes (swiss table).
+// Every slot has a control byte: EMPTY, DELETED or the low 7 bits of the hash of the key stored in it.
+// Lookups compare 16 control bytes at once and only touch the slots whose tag matches,
+// the rest of the hash selects the starting group. Length is always a power of two, groups are probed triangularly.
+// Deleted slots are left as DELETED, a rehash (same length if the table is mostly tombstones) drops them all.
+
 #define HASH_TABLE_INITIAL_LENGTH  256
-#define HASH_TABLE_REALLOC_STEP    128
-#define HASH_TABLE_MAX_LOAD_FACTOR 70
+#define HASH_TABLE_MAX_LOAD_FACTOR 87  // counts tombstones as well
+#define HASH_TABLE_NOT_FOUND       u32_max
+#define HASH_TABLE_GROUP_WIDTH     16
+
+#define HASH_TABLE_CTRL_EMPTY   ((u8)0x80)
+#define HASH_TABLE_CTRL_DELETED ((u8)0xFE)
 
 #define HASH_TABLE_TEMPLATE export template <typename Key, typename Value>
 
@@ -19,24 +43,22 @@ HASH_TABLE_TEMPLATE
 struct HashTableSlot {
     Key   key;
     Value value;
-    u64   hash;
-    bool  tombstone;
 };
 
 HASH_TABLE_TEMPLATE
 struct HashTableIterator {
     HashTableSlot<Key, Value>* slots;
+    u8*                        ctrl;
     u32                        current;
     u32                        length;
 
-    HashTableIterator(HashTableSlot<Key, Value>* s, u32 start, u32 len)
-        : slots(s), current(start), length(len) {
+    HashTableIterator(HashTableSlot<Key, Value>* s, u8* c, u32 start, u32 len)
+        : slots(s), ctrl(c), current(start), length(len) {
         advance_to_valid();
     }
 
     void advance_to_valid() {
-        while (current < length && 
-               (slots[current].hash == 0 || slots[current].tombstone)) {
+        while (current < length && (ctrl[current] & 0x80)) {
             ++current;
         }
     }
@@ -61,89 +83,216 @@ struct HashTableIterator {
     }
 };
 
+inline
+u32
+table_ctz(u32 mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (u32)index;
+#else
+    return (u32)__builtin_ctz(mask);
+#endif
+}
+
+// Bit i is set when control byte i of the group equals the tag.
+inline
+u32
+table_group_match(const u8* ctrl, u8 tag) {
+#if defined(HASH_TABLE_SSE2)
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#elif defined(HASH_TABLE_NEON)
+    static const u8 bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+
+    uint8x16_t equal  = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(tag));
+    uint8x16_t masked = vandq_u8(equal, vld1q_u8(bits));
+
+    return (u32)vaddv_u8(vget_low_u8(masked)) | ((u32)vaddv_u8(vget_high_u8(masked)) << 8);
+#else
+    u32 mask = 0;
+
+    for (u32 i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) {
+        if (ctrl[i] == tag) mask |= 1u << i;
+    }
+
+    return mask;
+#endif
+}
+
+// Bit i is set when control byte i of the group is EMPTY or DELETED, both have the high bit set.
+inline
+u32
+table_group_match_free(const u8* ctrl) {
+#if defined(HASH_TABLE_SSE2)
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)ctrl));
+#elif defined(HASH_TABLE_NEON)
+    static const u8 bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+
+    uint8x16_t high   = vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl)), vdupq_n_s8(0));
+    uint8x16_t masked = vandq_u8(high, vld1q_u8(bits));
+
+    return (u32)vaddv_u8(vget_low_u8(masked)) | ((u32)vaddv_u8(vget_high_u8(masked)) << 8);
+#else
+    u32 mask = 0;
+
+    for (u32 i = 0; i < HASH_TABLE_GROUP_WIDTH; i++) {
+        if (ctrl[i] & 0x80) mask |= 1u << i;
+    }
+
+    return mask;
+#endif
+}
+
+// The low 7 bits are the tag stored in the control byte, the rest picks the first group to probe.
+export template <typename Key>
+inline
+u64
+table_hash(Key key) {
+    return get_hash(key);
+}
+
+inline u8  table_hash_tag(u64 hash)   { return (u8)(hash & 0x7F); }
+inline u32 table_hash_group(u64 hash) { return (u32)(hash >> 7); }
+
+export struct HashTableProbeStats {
+    u32 count;
+    u32 groups_total;        // groups probed by successful lookups of every key
+    u32 groups_max;          // longest lookup in groups
+    u32 tag_false_positives; // slots whose tag matched but the key did not
+};
+
+HASH_TABLE_TEMPLATE
+struct HashTable;
+
+HASH_TABLE_TEMPLATE
+inline
+u32
+table_find(const HashTable<Key, Value>* hash_table, Key key, u64 hash);
+
 HASH_TABLE_TEMPLATE
 struct HashTable {
     HashTableSlot<Key, Value>* data;
+    u8*                        ctrl;      // length + HASH_TABLE_GROUP_WIDTH bytes, the first group is mirrored at the end
     Allocator*                 allocator;
     u32                        count;
-    u32                        length;
+    u32                        deleted;
+    u32                        length;    // power of two
+    u32                        mask;      // length - 1
 
-    HashTable() : data(NULL), allocator(NULL), count(0), length(0){};
+    HashTable() : data(NULL), ctrl(NULL), allocator(NULL), count(0), deleted(0), length(0), mask(0){};
     ~HashTable() = default;
 
     Value& operator[](Key key) {
-        Assert(data, "Cannot get value from uninitalized hash table, use table_make to initialize it");        
-        u64 hash      = get_hash(key);
-        u32 iteration = 0;
-        u32 index     = 0;
-
-        while (true) {
-            index = table_double_hash(hash, length, iteration++);
-
-            if (data[index].tombstone)    continue;
-            if (data[index].hash == hash && data[index].key == key) break;
-            if (data[index].hash == 0) {
-                Errf("The key was not presented in the hash table.");
-                return {};
-            };
-        }
+        Assert(data, "Cannot get value from uninitalized hash table, use table_make to initialize it");
+        u32 index = table_find(this, key, table_hash(key));
+        Assert(index != HASH_TABLE_NOT_FOUND, "The key was not presented in the hash table.");
 
         return data[index].value;
     }
 
     const Value& operator[](Key key) const {
         Assert(data, "Cannot get value from uninitalized hash table, use table_make to initialize it");
-        u64 hash      = get_hash(key);
-        u32 iteration = 0;
-        u32 index     = 0;
-
-        while (true) {
-            index = table_double_hash(hash, length, iteration++);
-
-            if (data[index].tombstone)    continue;
-            if (data[index].hash == hash && data[index].key == key) break;
-            if (data[index].hash == 0) {
-                Errf("The key was not presented in the hash table.");
-                return {};
-            };
-        }
+        u32 index = table_find(this, key, table_hash(key));
+        Assert(index != HASH_TABLE_NOT_FOUND, "The key was not presented in the hash table.");
 
         return data[index].value;
     }
 
     HashTableIterator<Key, Value> begin() {
-        return HashTableIterator(data, 0, length);
+        return HashTableIterator(data, ctrl, 0, length);
     }
 
     HashTableIterator<Key, Value> end() {
-        return HashTableIterator(data, length, length);
+        return HashTableIterator(data, ctrl, length, length);
     }
 };
 
+HASH_TABLE_TEMPLATE
 inline
-u64
-table_double_hash(u64 hash, u32 length, u32 iteration = 0);
+void
+table_set_ctrl(HashTable<Key, Value>* hash_table, u32 index, u8 ctrl) {
+    hash_table->ctrl[index] = ctrl;
 
+    if (index < HASH_TABLE_GROUP_WIDTH) {
+        hash_table->ctrl[hash_table->length + index] = ctrl;
+    }
+}
+
+HASH_TABLE_TEMPLATE
 inline
-u64
-table_double_hash(u64 hash, u32 length, u32 iteration) {
-    u64 secondary = 1 + (hash % (length - 1));
-    return (hash + iteration * secondary) % length;
+u32
+table_find(const HashTable<Key, Value>* hash_table, Key key, u64 hash) {
+    u32 mask   = hash_table->mask;
+    u32 index  = table_hash_group(hash) & mask;
+    u32 stride = 0;
+    u8  tag    = table_hash_tag(hash);
+
+    while (true) {
+        const u8* group   = &hash_table->ctrl[index];
+        u32       matches = table_group_match(group, tag);
+
+        while (matches) {
+            u32 slot = (index + table_ctz(matches)) & mask;
+
+            if (hash_table->data[slot].key == key) return slot;
+
+            matches &= matches - 1;
+        }
+
+        if (table_group_match(group, HASH_TABLE_CTRL_EMPTY)) return HASH_TABLE_NOT_FOUND;
+
+        stride += HASH_TABLE_GROUP_WIDTH;
+        index   = (index + stride) & mask;
+    }
+}
+
+// First EMPTY or DELETED slot on the probe sequence of the hash.
+HASH_TABLE_TEMPLATE
+inline
+u32
+table_find_free(const HashTable<Key, Value>* hash_table, u64 hash) {
+    u32 mask   = hash_table->mask;
+    u32 index  = table_hash_group(hash) & mask;
+    u32 stride = 0;
+
+    while (true) {
+        u32 free = table_group_match_free(&hash_table->ctrl[index]);
+
+        if (free) return (index + table_ctz(free)) & mask;
+
+        stride += HASH_TABLE_GROUP_WIDTH;
+        index   = (index + stride) & mask;
+    }
 }
 
 HASH_TABLE_TEMPLATE
 inline
 void
-table_make(HashTable<Key, Value>* hash_table, Allocator* allocator = Allocator_Persistent, u32 length = HASH_TABLE_INITIAL_LENGTH) {
-    auto data = (HashTableSlot<Key, Value>*)allocator->alloc(sizeof(HashTableSlot<Key, Value>) * length);
-    Assert(data, "Cannot allocate memory for hash_table data.");
+table_alloc(HashTable<Key, Value>* hash_table, u32 length) {
+    u64 slots_size = sizeof(HashTableSlot<Key, Value>) * length;
+
+    auto data = (u8*)hash_table->allocator->alloc(slots_size + length + HASH_TABLE_GROUP_WIDTH);
+    Assert(data, "Cannot allocate memory for hash table data.");
+
+    memset(data, 0, slots_size);
+    memset(data + slots_size, HASH_TABLE_CTRL_EMPTY, length + HASH_TABLE_GROUP_WIDTH);
 
-    memset(data, 0, sizeof(HashTableSlot<Key, Value>) * length);
+    hash_table->data    = (HashTableSlot<Key, Value>*)data;
+    hash_table->ctrl    = data + slots_size;
+    hash_table->count   = 0;
+    hash_table->deleted = 0;
+    hash_table->length  = length;
+    hash_table->mask    = length - 1;
+}
 
-    hash_table->data      = data;
-    hash_table->count     = 0;
-    hash_table->length    = length;
+HASH_TABLE_TEMPLATE
+inline
+void
+table_make(HashTable<Key, Value>* hash_table, Allocator* allocator = Allocator_Persistent, u32 length = HASH_TABLE_INITIAL_LENGTH) {
     hash_table->allocator = allocator;
+
+    table_alloc(hash_table, next_power_of_2(length < HASH_TABLE_GROUP_WIDTH ? HASH_TABLE_GROUP_WIDTH : length));
 }
 
 HASH_TABLE_TEMPLATE
@@ -152,56 +301,88 @@ HashTable<Key, Value>
 table_make(Allocator* allocator = Allocator_Persistent, u32 length = HASH_TABLE_INITIAL_LENGTH) {
     HashTable<Key, Value> table{};
 
-    auto data = (HashTableSlot<Key, Value>*)allocator->alloc(sizeof(HashTableSlot<Key, Value>) * length);
-    Assert(data, "Cannot allocate memory for hash table data.");
-
-    memset(data, 0, sizeof(HashTableSlot<Key, Value>) * length);
-
-    table.data      = data;
-    table.count     = 0;
-    table.length    = length;
-    table.allocator = allocator;
+    table_make(&table, allocator, length);
 
     return table;
 }
 
+// Moves live slots into a fresh allocation, tombstones are dropped. Length may stay the same.
 HASH_TABLE_TEMPLATE
 inline
 void
-table_realloc(HashTable<Key, Value>* hash_table, u32 length) {
+table_rehash(HashTable<Key, Value>* hash_table, u32 length) {
     Assert(hash_table->data, "Cannot realloc uninitalized hash table, use table_make to initialize it");
 
-    Assert(length > hash_table->length, "Cannot resize hash table with less size.");
+    length = next_power_of_2(length);
 
-    auto new_data = (HashTableSlot<Key, Value>*)hash_table->allocator->alloc(sizeof(HashTableSlot<Key, Value>) * length);
-    Assert(new_data, "Cannot allocate enough memory for new hash table data");
+    Assert(length >= hash_table->length, "Cannot resize hash table with less size.");
 
-    memset(new_data, 0, sizeof(HashTableSlot<Key, Value>) * length);
+    HashTableSlot<Key, Value>* old_data   = hash_table->data;
+    u8*                        old_ctrl   = hash_table->ctrl;
+    u32                        old_length = hash_table->length;
+    u32                        count      = hash_table->count;
 
-    for (u32 i = 0; i < hash_table->length; i++) {
-        if (hash_table->data[i].hash != 0) {
-            u32 iteration = 0;
-            u32 index     = 0;
+    table_alloc(hash_table, length);
 
-            while (true) {
-                index = table_double_hash(hash_table->data[i].hash, length, iteration++);
+    for (u32 i = 0; i < old_length; i++) {
+        if (old_ctrl[i] & 0x80) continue;
 
-                if (new_data[index].hash == 0) break;
-            }
+        u64 hash  = table_hash(old_data[i].key);
+        u32 index = table_find_free(hash_table, hash);
 
-            new_data[index].hash      = hash_table->data[i].hash;
-            new_data[index].key       = hash_table->data[i].key;
-            new_data[index].value     = hash_table->data[i].value;
-            new_data[index].tombstone = false;
-        }
+        table_set_ctrl(hash_table, index, table_hash_tag(hash));
+        hash_table->data[index] = old_data[i];
     }
 
+    hash_table->count = count;
+
     if (hash_table->allocator != Allocator_Temp) {
-        AllocatorFree(hash_table->allocator, hash_table->data);
+        AllocatorFree(hash_table->allocator, old_data);
+    }
+}
+
+HASH_TABLE_TEMPLATE
+inline
+void
+table_realloc(HashTable<Key, Value>* hash_table, u32 length) {
+    Assert(next_power_of_2(length) > hash_table->length, "Cannot resize hash table with less size.");
+
+    table_rehash(hash_table, length);
+}
+
+// Makes room for one more key. Doubles the table if it is full of live keys, otherwise only drops the tombstones.
+HASH_TABLE_TEMPLATE
+inline
+void
+table_reserve_one(HashTable<Key, Value>* hash_table) {
+    u32 used = hash_table->count + hash_table->deleted + 1;
+
+    if (used * 100 <= hash_table->length * HASH_TABLE_MAX_LOAD_FACTOR) return;
+
+    if ((hash_table->count + 1) * 100 * 2 > hash_table->length * HASH_TABLE_MAX_LOAD_FACTOR) {
+        table_rehash(hash_table, hash_table->length * 2);
+    } else {
+        table_rehash(hash_table, hash_table->length);
     }
+}
+
+HASH_TABLE_TEMPLATE
+inline
+void
+table_insert_new(HashTable<Key, Value>* hash_table, Key key, Value value, u64 hash) {
+    table_reserve_one(hash_table);
 
-    hash_table->data   = new_data;
-    hash_table->length = length;
+    u32 index = table_find_free(hash_table, hash);
+
+    if (hash_table->ctrl[index] == HASH_TABLE_CTRL_DELETED) {
+        hash_table->deleted--;
+    }
+
+    table_set_ctrl(hash_table, index, table_hash_tag(hash));
+
+    hash_table->data[index].key   = key;
+    hash_table->data[index].value = value;
+    hash_table->count++;
 }
 
 HASH_TABLE_TEMPLATE
@@ -220,35 +401,14 @@ inline
 void
 table_add(HashTable<Key, Value>* hash_table, Key key, Value value) {
     Assert(hash_table->data, "Cannot add to uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    Assert(hash != 0, "Hash cannot be 0, fix your hash function.");
-    u32 iteration = 0;
-    u32 index     = 0;
+    u64 hash = table_hash(key);
 
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
-
-        if (hash_table->data[index].tombstone)    break;
-        if (hash_table->data[index].hash == 0)    break;
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) {
-            Err("An item with the same key has already been added.");
-            return;
-        }
+    if (table_find(hash_table, key, hash) != HASH_TABLE_NOT_FOUND) {
+        Err("An item with the same key has already been added.");
+        return;
     }
 
-    auto slot  = HashTableSlot<Key, Value> {};
-    slot.hash  = hash;
-    slot.value = value;
-    slot.key   = key;
-
-    hash_table->data[index] = slot;
-    hash_table->count++;
-
-    u32 load_factor = hash_table->count * 100 / hash_table->length;
-
-    if (load_factor >= HASH_TABLE_MAX_LOAD_FACTOR) {
-        table_realloc(hash_table, hash_table->length + HASH_TABLE_REALLOC_STEP);
-    }
+    table_insert_new(hash_table, key, value, hash);
 }
 
 HASH_TABLE_TEMPLATE
@@ -256,27 +416,14 @@ inline
 void
 table_set(HashTable<Key, Value>* hash_table, Key key, Value value) {
     Assert(hash_table->data, "Cannot set uninitialized hash table data, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
-
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-        if (hash_table->data[index].tombstone)    continue;
-        if (hash_table->data[index].hash == 0)    break;
-        if (hash_table->data[index].hash == hash && hash_table->hash_table->data[index].key == key) {
-            Err("The key is not presented in the hash table.");
-            return;
-        }
+    if (index == HASH_TABLE_NOT_FOUND) {
+        Err("The key is not presented in the hash table.");
+        return;
     }
 
-    auto slot  = HashTableSlot<Key, Value> {};
-    slot.hash  = hash;
-    slot.value = value;
-    slot.key   = key;
-
-    hash_table->data[index] = slot;
+    hash_table->data[index].value = value;
 }
 
 HASH_TABLE_TEMPLATE
@@ -284,40 +431,28 @@ inline
 bool
 table_add_or_set(HashTable<Key, Value>* hash_table, Key key, Value value) {
     Assert(hash_table->data, "Cannot add to uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
-
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
-
-        if (hash_table->data[index].tombstone)    break;
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) break;
-        if (hash_table->data[index].hash == 0)    break;
-    }
-
-    bool has = false;
+    u64 hash  = table_hash(key);
+    u32 index = table_find(hash_table, key, hash);
 
-    if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) {
-        has = true;
+    if (index != HASH_TABLE_NOT_FOUND) {
+        hash_table->data[index].value = value;
+        return true;
     }
 
-    auto slot = HashTableSlot<Key, Value> {};
-    slot.hash  = hash;
-    slot.value = value;
-    slot.key   = key;
-    hash_table->data[index] = slot;
+    table_insert_new(hash_table, key, value, hash);
 
-    if (!has) {
-        hash_table->count++;
-        u32 load_factor = hash_table->count * 100 / hash_table->length;
+    return false;
+}
 
-        if (load_factor >= HASH_TABLE_MAX_LOAD_FACTOR) {
-            table_realloc(hash_table, hash_table->length + HASH_TABLE_REALLOC_STEP);
-        }
-    }
+HASH_TABLE_TEMPLATE
+inline
+void
+table_remove_at(HashTable<Key, Value>* hash_table, u32 index) {
+    table_set_ctrl(hash_table, index, HASH_TABLE_CTRL_DELETED);
 
-    return has;
+    hash_table->data[index] = HashTableSlot<Key, Value> {};
+    hash_table->count--;
+    hash_table->deleted++;
 }
 
 HASH_TABLE_TEMPLATE
@@ -325,26 +460,14 @@ inline
 void
 table_remove(HashTable<Key, Value>* hash_table, Key key) {
     Assert(hash_table->data, "Cannot remove from uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
-
-        if (hash_table->data[index].tombstone)    continue;
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) break;
-        if (hash_table->data[index].hash == 0) {
-            Err("A key, you want to remove is not present in the hash table.");
-            return;
-        }
+    if (index == HASH_TABLE_NOT_FOUND) {
+        Err("A key, you want to remove is not present in the hash table.");
+        return;
     }
 
-    hash_table->data[index].tombstone = true;
-    hash_table->data[index].hash      = 0;
-    hash_table->data[index].value     = {};
-    hash_table->data[index].key       = {};
-    hash_table->count--;
+    table_remove_at(hash_table, index);
 }
 
 HASH_TABLE_TEMPLATE
@@ -352,26 +475,11 @@ inline
 bool
 table_remove_if_contains(HashTable<Key, Value>* hash_table, Key key) {
     Assert(hash_table->data, "Cannot remove from uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
-
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-        if (hash_table->data[index].tombstone)    continue;
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) break;
-        if (hash_table->data[index].hash == 0)    break;
-    }
+    if (index == HASH_TABLE_NOT_FOUND) return false;
 
-    if (hash_table->data[index].hash != hash || hash_table->data[index].key != key) {
-        return false;
-    }
-
-    hash_table->data[index].tombstone = true;
-    hash_table->data[index].hash      = 0;
-    hash_table->data[index].value     = {};
-    hash_table->count--;
+    table_remove_at(hash_table, index);
 
     return true;
 }
@@ -381,17 +489,8 @@ inline
 bool
 table_contains(HashTable<Key, Value>* hash_table, Key key) {
     Assert(hash_table->data, "Cannot search in uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
-
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
 
-        if (hash_table->data[index].tombstone)    continue;
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) return true;
-        if (hash_table->data[index].hash == 0)    return false;
-    }
+    return table_find(hash_table, key, table_hash(key)) != HASH_TABLE_NOT_FOUND;
 }
 
 HASH_TABLE_TEMPLATE
@@ -399,18 +498,11 @@ inline
 Value
 table_get(HashTable<Key, Value>* hash_table, Key key) {
     Assert(hash_table->data, "Cannot get value from uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
-
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-        if (hash_table->data[index].tombstone)    continue;
+    if (index == HASH_TABLE_NOT_FOUND) return NULL;
 
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) return hash_table->data[index].value;
-        if (hash_table->data[index].hash == 0)    return NULL;
-    }
+    return hash_table->data[index].value;
 }
 
 HASH_TABLE_TEMPLATE
@@ -418,18 +510,11 @@ inline
 Value*
 table_get_ptr(HashTable<Key, Value>* hash_table, Key key) {
     Assert(hash_table->data, "Cannot get value from uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
-
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-        if (hash_table->data[index].tombstone)    continue;
+    if (index == HASH_TABLE_NOT_FOUND) return NULL;
 
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) return &hash_table->data[index].value;
-        if (hash_table->data[index].hash == 0)    return NULL;
-    }
+    return &hash_table->data[index].value;
 }
 
 HASH_TABLE_TEMPLATE
@@ -437,24 +522,13 @@ inline
 bool
 table_try_get(HashTable<Key, Value>* hash_table, Key key, Value* value) {
     Assert(hash_table->data, "Cannot get value from uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
+    if (index == HASH_TABLE_NOT_FOUND) return false;
 
-        if (hash_table->data[index].tombstone)    continue;
+    *value = hash_table->data[index].value;
 
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) {
-            *value = hash_table->data[index].value;
-            return true;
-        }
-        
-        if (hash_table->data[index].hash == 0)    return false;
-    }
-
-    return false;
+    return true;
 }
 
 HASH_TABLE_TEMPLATE
@@ -462,21 +536,61 @@ inline
 bool
 table_try_get_ptr(HashTable<Key, Value>* hash_table, Key key, Value** value) {
     Assert(hash_table->data, "Cannot get value from uninitalized hash table, use table_make to initialize it");
-    u64 hash      = get_hash(key);
-    u32 iteration = 0;
-    u32 index     = 0;
+    u32 index = table_find(hash_table, key, table_hash(key));
 
-    while (true) {
-        index = table_double_hash(hash, hash_table->length, iteration++);
+    if (index == HASH_TABLE_NOT_FOUND) return false;
+
+    *value = &hash_table->data[index].value;
+
+    return true;
+}
+
+// Replays a lookup of every key in the table and gathers probe lengths, to measure hash functions.
+HASH_TABLE_TEMPLATE
+inline
+HashTableProbeStats
+table_probe_stats(HashTable<Key, Value>* hash_table) {
+    Assert(hash_table->data, "Cannot inspect uninitalized hash table, use table_make to initialize it");
+    HashTableProbeStats stats = {};
+
+    for (u32 i = 0; i < hash_table->length; i++) {
+        if (hash_table->ctrl[i] & 0x80) continue;
+
+        Key key    = hash_table->data[i].key;
+        u64 hash   = table_hash(key);
+        u32 mask   = hash_table->mask;
+        u32 index  = table_hash_group(hash) & mask;
+        u32 stride = 0;
+        u32 groups = 1;
 
-        if (hash_table->data[index].tombstone)    continue;
+        while (true) {
+            u32  matches = table_group_match(&hash_table->ctrl[index], table_hash_tag(hash));
+            bool found   = false;
+
+            while (matches) {
+                u32 slot = (index + table_ctz(matches)) & mask;
+
+                if (hash_table->data[slot].key == key) {
+                    found = true;
+                    break;
+                }
+
+                stats.tag_false_positives++;
+                matches &= matches - 1;
+            }
+
+            if (found) break;
 
-        if (hash_table->data[index].hash == hash && hash_table->data[index].key == key) {
-            *value = &hash_table->data[index].value;
-            return true;
+            stride += HASH_TABLE_GROUP_WIDTH;
+            index   = (index + stride) & mask;
+            groups++;
         }
-        
-        if (hash_table->data[index].hash == 0)    return false;
+
+        stats.count++;
+        stats.groups_total += groups;
+
+        if (groups > stats.groups_max) stats.groups_max = groups;
     }
-    return false;
-}
\ No newline at end of file
+
+    return stats;
+}
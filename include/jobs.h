@@ -0,0 +1,288 @@
+#pragma once
+
+#include "types.h"
+#include "assert.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// #define JOBS_IMPLEMENTATION in exactly one translation unit.
+//
+// Every thread (workers and the main thread) owns a deque. The owner pushes and pops at the bottom,
+// idle threads steal from the top of the other deques (Chase-Lev).
+
+#define JOBS_MAX_THREADS   64
+#define JOBS_DEQUE_LENGTH  4096 // must be a power of two
+#define JOBS_STEAL_ATTEMPTS 64  // failed rounds before a worker goes to sleep
+
+typedef void (*JobProc)(void* data);
+
+// Number of jobs in flight. Incremented on submit, decremented when a job finishes.
+struct JobCounter {
+    std::atomic<u32> value{0};
+};
+
+struct Job {
+    JobProc     proc;
+    void*       data;
+    JobCounter* counter;
+};
+
+void jobs_init(u32 threads_count = 0); // 0 - one worker per hardware thread except the main one
+void jobs_shutdown();
+u32  jobs_threads_count();             // workers + main thread
+u32  jobs_thread_index();              // 0 is the main thread
+void jobs_submit(Job job);             // only from the main thread or from inside a job
+void jobs_wait(JobCounter* counter);   // runs pending jobs until the counter drops to zero
+
+#ifdef JOBS_IMPLEMENTATION
+
+// Thieves read a slot before they know it is theirs, so the fields are relaxed atomics (plain moves on x64).
+struct JobSlot {
+    std::atomic<JobProc>     proc;
+    std::atomic<void*>       data;
+    std::atomic<JobCounter*> counter;
+};
+
+struct alignas(64) JobDeque {
+    std::atomic<s64> top;
+    std::atomic<s64> bottom;
+    JobSlot          slots[JOBS_DEQUE_LENGTH];
+};
+
+static JobDeque*         Job_Deques;
+static std::thread*      Job_Workers[JOBS_MAX_THREADS];
+static u32               Job_Workers_Count = 0;
+static std::atomic<bool> Jobs_Running{false};
+
+// Sleeping workers are woken up through the condition variable, only when there is someone to wake.
+static std::mutex              Jobs_Sleep_Mutex;
+static std::condition_variable Jobs_Sleep_Signal;
+static std::atomic<u32>        Jobs_Queued{0};
+static std::atomic<u32>        Jobs_Sleeping{0};
+
+static thread_local u32 Job_Thread_Index = 0;
+static thread_local u32 Job_Steal_Seed   = 0;
+
+static inline void job_slot_write(JobSlot* slot, Job job) {
+    slot->proc.store(job.proc, std::memory_order_relaxed);
+    slot->data.store(job.data, std::memory_order_relaxed);
+    slot->counter.store(job.counter, std::memory_order_relaxed);
+}
+
+static inline Job job_slot_read(JobSlot* slot) {
+    Job job = {
+        .proc    = slot->proc.load(std::memory_order_relaxed),
+        .data    = slot->data.load(std::memory_order_relaxed),
+        .counter = slot->counter.load(std::memory_order_relaxed),
+    };
+
+    return job;
+}
+
+static inline bool job_deque_push(JobDeque* deque, Job job) {
+    s64 bottom = deque->bottom.load(std::memory_order_relaxed);
+    s64 top    = deque->top.load(std::memory_order_acquire);
+
+    if (bottom - top >= JOBS_DEQUE_LENGTH) return false;
+
+    job_slot_write(&deque->slots[bottom & (JOBS_DEQUE_LENGTH - 1)], job);
+    deque->bottom.store(bottom + 1, std::memory_order_release);
+
+    return true;
+}
+
+static inline bool job_deque_pop(JobDeque* deque, Job* job) {
+    s64 bottom = deque->bottom.load(std::memory_order_relaxed) - 1;
+    deque->bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 top = deque->top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    *job = job_slot_read(&deque->slots[bottom & (JOBS_DEQUE_LENGTH - 1)]);
+
+    if (top == bottom) {
+        // Last job, race against the thieves.
+        bool won = deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        deque->bottom.store(bottom + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    return true;
+}
+
+static inline bool job_deque_steal(JobDeque* deque, Job* job) {
+    s64 top = deque->top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    s64 bottom = deque->bottom.load(std::memory_order_acquire);
+
+    if (top >= bottom) return false;
+
+    *job = job_slot_read(&deque->slots[top & (JOBS_DEQUE_LENGTH - 1)]);
+
+    return deque->top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+static inline void job_run(Job job) {
+    job.proc(job.data);
+
+    if (job.counter) {
+        job.counter->value.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+// Takes a job from the own deque first, then tries to steal from the others starting at a random one.
+static inline bool job_find(Job* job) {
+    u32 self  = Job_Thread_Index;
+    u32 count = Job_Workers_Count + 1;
+
+    if (job_deque_pop(&Job_Deques[self], job)) {
+        Jobs_Queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Job_Steal_Seed = Job_Steal_Seed * 1664525u + 1013904223u;
+    u32 start = Job_Steal_Seed % count;
+
+    for (u32 i = 0; i < count; i++) {
+        u32 victim = (start + i) % count;
+
+        if (victim == self) continue;
+
+        if (job_deque_steal(&Job_Deques[victim], job)) {
+            Jobs_Queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void job_worker_main(u32 index) {
+    Job_Thread_Index = index;
+    Job_Steal_Seed   = index;
+
+    u32 failed = 0;
+
+    while (Jobs_Running.load(std::memory_order_acquire)) {
+        Job job;
+
+        if (job_find(&job)) {
+            job_run(job);
+            failed = 0;
+            continue;
+        }
+
+        if (++failed < JOBS_STEAL_ATTEMPTS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(Jobs_Sleep_Mutex);
+
+        Jobs_Sleeping.fetch_add(1, std::memory_order_seq_cst);
+
+        Jobs_Sleep_Signal.wait(lock, [] {
+            return Jobs_Queued.load(std::memory_order_seq_cst) > 0 || Jobs_Running.load(std::memory_order_acquire) == false;
+        });
+
+        Jobs_Sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        failed = 0;
+    }
+}
+
+void jobs_init(u32 threads_count) {
+    Assert(Jobs_Running.load() == false, "Job system is already initialized.");
+
+    if (threads_count == 0) {
+        u32 hardware  = std::thread::hardware_concurrency();
+        threads_count = hardware > 1 ? hardware - 1 : 1;
+    }
+
+    if (threads_count > JOBS_MAX_THREADS - 1) threads_count = JOBS_MAX_THREADS - 1;
+
+    Job_Deques = new JobDeque[threads_count + 1];
+
+    for (u32 i = 0; i < threads_count + 1; i++) {
+        Job_Deques[i].top.store(0);
+        Job_Deques[i].bottom.store(0);
+    }
+
+    Job_Thread_Index  = 0;
+    Job_Workers_Count = threads_count;
+    Jobs_Queued.store(0);
+    Jobs_Running.store(true, std::memory_order_release);
+
+    for (u32 i = 0; i < threads_count; i++) {
+        Job_Workers[i] = new std::thread(job_worker_main, i + 1);
+    }
+}
+
+void jobs_shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(Jobs_Sleep_Mutex);
+        Jobs_Running.store(false, std::memory_order_release);
+    }
+
+    Jobs_Sleep_Signal.notify_all();
+
+    for (u32 i = 0; i < Job_Workers_Count; i++) {
+        Job_Workers[i]->join();
+        delete Job_Workers[i];
+    }
+
+    delete[] Job_Deques;
+
+    Job_Deques        = NULL;
+    Job_Workers_Count = 0;
+}
+
+u32 jobs_threads_count() {
+    return Job_Workers_Count + 1;
+}
+
+u32 jobs_thread_index() {
+    return Job_Thread_Index;
+}
+
+void jobs_submit(Job job) {
+    Assert(job.proc, "Cannot submit a job without a procedure.");
+
+    if (job.counter) {
+        job.counter->value.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // Counted before the push, so a thief never sees the job before it is queued.
+    Jobs_Queued.fetch_add(1, std::memory_order_seq_cst);
+
+    // Deque is full or there are no workers, run in place.
+    if (Job_Workers_Count == 0 || job_deque_push(&Job_Deques[Job_Thread_Index], job) == false) {
+        Jobs_Queued.fetch_sub(1, std::memory_order_relaxed);
+        job_run(job);
+        return;
+    }
+
+    if (Jobs_Sleeping.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> lock(Jobs_Sleep_Mutex);
+        Jobs_Sleep_Signal.notify_one();
+    }
+}
+
+void jobs_wait(JobCounter* counter) {
+    while (counter->value.load(std::memory_order_acquire) > 0) {
+        Job job;
+
+        if (job_find(&job)) {
+            job_run(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+#endif
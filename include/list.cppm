@@ -99,18 +99,8 @@ list_realloc(List<T> *list, u32 length) {
     Assert(list->data, "Cannot realloc uninitialized list, use list_make to initialize it.");
     Assert(length > list->length, "Cannot resize list with less size.");
 
-    if (list->allocator == Allocator_Temp) {
-        T* new_data = AllocatorAlloc(T, list->allocator, sizeof(T) * length);
-        Assert(new_data, "Cannot allocate enough memory for new list");
-
-        for (u32 i = 0; i < list->count; i++) {
-            new_data[i] = list->data[i];
-        }
-
-        list->data = new_data;
-    } else {
-        list->data = (T*)list->allocator->realloc(list->data, sizeof(T) * length);
-    }
+    // The arena grows its last allocation in place and copies otherwise, Allocator_Temp needs no special case.
+    list->data = (T*)list->allocator->realloc(list->data, sizeof(T) * length);
 
     Assert(list->data, "Cannot resize the list.");
     list->length = length;
@@ -3,6 +3,14 @@ module;
 #include <math.h>
 #include "debug.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATRIX4_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define MATRIX4_NEON
+#include <arm_neon.h>
+#endif
+
 import math;
 import vector3;
 import quaternion;
@@ -140,7 +148,43 @@ export inline Matrix4& operator-=(Matrix4& lhs, const Matrix4& rhs) {
     return lhs;
 }
 
-export inline Matrix4  operator*(const Matrix4& lhs, const Matrix4& rhs) {
+// Columns of the result are sums of the lhs columns scaled by one rhs column.
+inline Matrix4 matrix4_mul_columns(const Matrix4& lhs, const Matrix4& rhs) {
+#if defined(MATRIX4_SSE)
+    Matrix4 res;
+    __m128  c0 = _mm_loadu_ps(&lhs.e[0]);
+    __m128  c1 = _mm_loadu_ps(&lhs.e[4]);
+    __m128  c2 = _mm_loadu_ps(&lhs.e[8]);
+    __m128  c3 = _mm_loadu_ps(&lhs.e[12]);
+
+    for (int j = 0; j < 4; j++) {
+        const float* r = &rhs.e[4 * j];
+        __m128       v = _mm_mul_ps(c0, _mm_set1_ps(r[0]));
+
+        v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(r[1])));
+        v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(r[2])));
+        v = _mm_add_ps(v, _mm_mul_ps(c3, _mm_set1_ps(r[3])));
+
+        _mm_storeu_ps(&res.e[4 * j], v);
+    }
+#elif defined(MATRIX4_NEON)
+    Matrix4     res;
+    float32x4_t c0 = vld1q_f32(&lhs.e[0]);
+    float32x4_t c1 = vld1q_f32(&lhs.e[4]);
+    float32x4_t c2 = vld1q_f32(&lhs.e[8]);
+    float32x4_t c3 = vld1q_f32(&lhs.e[12]);
+
+    for (int j = 0; j < 4; j++) {
+        const float* r = &rhs.e[4 * j];
+        float32x4_t  v = vmulq_n_f32(c0, r[0]);
+
+        v = vmlaq_n_f32(v, c1, r[1]);
+        v = vmlaq_n_f32(v, c2, r[2]);
+        v = vmlaq_n_f32(v, c3, r[3]);
+
+        vst1q_f32(&res.e[4 * j], v);
+    }
+#else
     Matrix4 res {
         .m0  = lhs.m0*rhs.m0  + lhs.m1*rhs.m4  + lhs.m2*rhs.m8   + lhs.m3*rhs.m12,
         .m4  = lhs.m4*rhs.m0  + lhs.m5*rhs.m4  + lhs.m6*rhs.m8   + lhs.m7*rhs.m12,
@@ -160,9 +204,15 @@ export inline Matrix4  operator*(const Matrix4& lhs, const Matrix4& rhs) {
         .m15 = lhs.m12*rhs.m3 + lhs.m13*rhs.m7 + lhs.m14*rhs.m11 + lhs.m15*rhs.m15,
     };
 
+#endif
+
     return res;
 }
 
+export inline Matrix4  operator*(const Matrix4& lhs, const Matrix4& rhs) {
+    return matrix4_mul_columns(lhs, rhs);
+}
+
 export inline Matrix4 matrix4_add(const Matrix4& lhs, const Matrix4& rhs) {
     Matrix4 res {
         .m0 = lhs.m0 + rhs.m0,
@@ -210,26 +260,7 @@ export inline Matrix4 matrix4_sub(const Matrix4& lhs, const Matrix4& rhs) {
 }
 
 export inline Matrix4 matrix4_mul(const Matrix4& lhs, const Matrix4& rhs) {
-    Matrix4 res {
-        .m0  = lhs.m0*rhs.m0  + lhs.m1*rhs.m4  + lhs.m2*rhs.m8   + lhs.m3*rhs.m12,
-        .m1  = lhs.m0*rhs.m1  + lhs.m1*rhs.m5  + lhs.m2*rhs.m9   + lhs.m3*rhs.m13,
-        .m2  = lhs.m0*rhs.m2  + lhs.m1*rhs.m6  + lhs.m2*rhs.m10  + lhs.m3*rhs.m14,
-        .m3  = lhs.m0*rhs.m3  + lhs.m1*rhs.m7  + lhs.m2*rhs.m11  + lhs.m3*rhs.m15,
-        .m4  = lhs.m4*rhs.m0  + lhs.m5*rhs.m4  + lhs.m6*rhs.m8   + lhs.m7*rhs.m12,
-        .m5  = lhs.m4*rhs.m1  + lhs.m5*rhs.m5  + lhs.m6*rhs.m9   + lhs.m7*rhs.m13,
-        .m6  = lhs.m4*rhs.m2  + lhs.m5*rhs.m6  + lhs.m6*rhs.m10  + lhs.m7*rhs.m14,
-        .m7  = lhs.m4*rhs.m3  + lhs.m5*rhs.m7  + lhs.m6*rhs.m11  + lhs.m7*rhs.m15,
-        .m8  = lhs.m8*rhs.m0  + lhs.m9*rhs.m4  + lhs.m10*rhs.m8  + lhs.m11*rhs.m12,
-        .m9  = lhs.m8*rhs.m1  + lhs.m9*rhs.m5  + lhs.m10*rhs.m9  + lhs.m11*rhs.m13,
-        .m10 = lhs.m8*rhs.m2  + lhs.m9*rhs.m6  + lhs.m10*rhs.m10 + lhs.m11*rhs.m14,
-        .m11 = lhs.m8*rhs.m3  + lhs.m9*rhs.m7  + lhs.m10*rhs.m11 + lhs.m11*rhs.m15,
-        .m12 = lhs.m12*rhs.m0 + lhs.m13*rhs.m4 + lhs.m14*rhs.m8  + lhs.m15*rhs.m12,
-        .m13 = lhs.m12*rhs.m1 + lhs.m13*rhs.m5 + lhs.m14*rhs.m9  + lhs.m15*rhs.m13,
-        .m14 = lhs.m12*rhs.m2 + lhs.m13*rhs.m6 + lhs.m14*rhs.m10 + lhs.m15*rhs.m14,
-        .m15 = lhs.m12*rhs.m3 + lhs.m13*rhs.m7 + lhs.m14*rhs.m11 + lhs.m15*rhs.m15,
-    };
-
-    return res;
+    return matrix4_mul_columns(lhs, rhs);
 }
 
 export inline float   matrix4_det(const Matrix4& mat) {
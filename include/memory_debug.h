@@ -0,0 +1,283 @@
+#pragma once
+
+#include "types.h"
+
+// Allocation tracking for MEMORY_DEBUG builds.
+// #define MEMORY_DEBUG_IMPLEMENTATION in exactly one translation unit.
+//
+// Every tracked block starts with a MemoryHeader holding its size and tag, so freeing and reallocating
+// need no lookup and the counters are a few relaxed atomics per call. One in MEMORY_SAMPLE_RATE allocations
+// of a thread also captures its call stack, live sampled blocks are linked under a mutex and listed by memory_leak_report.
+// Blocks from memory_alloc must only be freed with memory_free, the header magic catches the mix ups.
+
+enum MemoryTag : u32 {
+    MEMORY_TAG_CONTAINERS = 0, // Allocator_Persistent, the default of List, Queue, HashTable and Array
+    MEMORY_TAG_TEXT       = 1, // Allocator_Text
+    MEMORY_TAG_ECS        = 2, // COMPONENTS_MALLOC
+    MEMORY_TAG_RENDER     = 3, // Allocator_Render
+    MEMORY_TAG_TEMP       = 4, // arena buckets
+    MEMORY_TAG_COUNT      = 5,
+};
+
+#ifdef MEMORY_DEBUG
+
+#include <atomic>
+
+#ifdef MEMORY_DEBUG_CUSTOM_MALLOC
+#else
+    #include <stdlib.h>
+
+    #define Memory_Malloc(size)       ::malloc(size)
+    #define Memory_Realloc(ptr, size) ::realloc(ptr, size)
+    #define Memory_Free(ptr)          ::free(ptr)
+#endif
+
+#define MEMORY_HEADER_MAGIC  0x4D454D31u // live block
+#define MEMORY_FREED_MAGIC   0x46524545u // catches double frees
+#define MEMORY_SAMPLE_RATE   256         // one in this many allocations of a thread captures the call stack
+#define MEMORY_SAMPLE_FRAMES 16
+
+struct MemorySample {
+    MemorySample* prev;
+    MemorySample* next;
+    void*         frames[MEMORY_SAMPLE_FRAMES];
+    u32           frames_count;
+    u32           tag;
+    u64           size;
+};
+
+// Keeps the block behind it aligned like malloc does.
+struct alignas(16) MemoryHeader {
+    u64           size;
+    MemorySample* sample; // NULL if the call stack was not captured
+    u32           tag;
+    u32           magic;
+};
+
+struct alignas(64) MemoryTagStats {
+    std::atomic<s64> live;              // bytes
+    std::atomic<s64> peak;
+    std::atomic<s64> blocks;
+    std::atomic<u64> allocations;       // total, reallocations included
+    s64              frame_live;        // values at the last memory_frame_report
+    u64              frame_allocations;
+};
+
+const char* memory_tag_name(u32 tag);
+void*       memory_alloc(u64 size, u32 tag);
+void*       memory_realloc(void* ptr, u64 size, u32 tag); // tag is only used when ptr is NULL
+void        memory_free(void* ptr);
+s64         memory_live(u32 tag);
+void        memory_frame_report(); // live, peak and the change since the last call per tag
+void        memory_leak_report();  // live bytes per tag and the call stacks of the live sampled blocks
+
+#ifdef MEMORY_DEBUG_IMPLEMENTATION
+
+#include <stdio.h>
+#include <mutex>
+#include "assert.h"
+
+#if defined(_WIN32)
+    #include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <execinfo.h>
+    #define MEMORY_BACKTRACE
+#endif
+
+static MemoryTagStats Memory_Stats[MEMORY_TAG_COUNT];
+static std::mutex     Memory_Samples_Mutex;
+static MemorySample*  Memory_Samples = NULL;
+
+static thread_local u32 Memory_Sample_Countdown = MEMORY_SAMPLE_RATE;
+
+static const char* Memory_Tag_Names[MEMORY_TAG_COUNT] = {
+    "containers",
+    "text",
+    "ecs",
+    "render",
+    "temp",
+};
+
+const char* memory_tag_name(u32 tag) {
+    return tag < MEMORY_TAG_COUNT ? Memory_Tag_Names[tag] : "unknown";
+}
+
+// Frees pass -1 blocks and are not counted as allocations.
+static inline void memory_count(u32 tag, s64 bytes, s64 blocks) {
+    MemoryTagStats* stats = &Memory_Stats[tag];
+
+    s64 live = stats->live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    s64 peak = stats->peak.load(std::memory_order_relaxed);
+
+    while (live > peak && stats->peak.compare_exchange_weak(peak, live, std::memory_order_relaxed) == false) {}
+
+    stats->blocks.fetch_add(blocks, std::memory_order_relaxed);
+    if (blocks >= 0) stats->allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+static inline MemorySample* memory_sample(u64 size, u32 tag) {
+    if (--Memory_Sample_Countdown > 0) return NULL;
+
+    Memory_Sample_Countdown = MEMORY_SAMPLE_RATE;
+
+    MemorySample* sample = (MemorySample*)Memory_Malloc(sizeof(MemorySample));
+
+    if (sample == NULL) return NULL;
+
+    sample->tag          = tag;
+    sample->size         = size;
+    sample->frames_count = 0;
+
+#if defined(_WIN32)
+    sample->frames_count = CaptureStackBackTrace(2, MEMORY_SAMPLE_FRAMES, sample->frames, NULL);
+#elif defined(MEMORY_BACKTRACE)
+    sample->frames_count = (u32)backtrace(sample->frames, MEMORY_SAMPLE_FRAMES);
+#endif
+
+    std::lock_guard<std::mutex> lock(Memory_Samples_Mutex);
+
+    sample->prev = NULL;
+    sample->next = Memory_Samples;
+
+    if (Memory_Samples) Memory_Samples->prev = sample;
+
+    Memory_Samples = sample;
+
+    return sample;
+}
+
+static inline void memory_sample_free(MemorySample* sample) {
+    {
+        std::lock_guard<std::mutex> lock(Memory_Samples_Mutex);
+
+        if (sample->prev) sample->prev->next = sample->next;
+        else              Memory_Samples     = sample->next;
+
+        if (sample->next) sample->next->prev = sample->prev;
+    }
+
+    Memory_Free(sample);
+}
+
+static inline MemoryHeader* memory_header(void* ptr) {
+    MemoryHeader* header = (MemoryHeader*)ptr - 1;
+
+    Assertf(header->magic != MEMORY_FREED_MAGIC, "Block %p is freed twice.", ptr);
+    Assertf(header->magic == MEMORY_HEADER_MAGIC, "Block %p was not allocated by the memory tracker.", ptr);
+
+    return header;
+}
+
+void* memory_alloc(u64 size, u32 tag) {
+    Assert(tag < MEMORY_TAG_COUNT, "Unknown memory tag.");
+
+    MemoryHeader* header = (MemoryHeader*)Memory_Malloc(sizeof(MemoryHeader) + size);
+
+    if (header == NULL) return NULL;
+
+    header->size   = size;
+    header->tag    = tag;
+    header->magic  = MEMORY_HEADER_MAGIC;
+    header->sample = memory_sample(size, tag);
+
+    memory_count(tag, (s64)size, 1);
+
+    return header + 1;
+}
+
+void* memory_realloc(void* ptr, u64 size, u32 tag) {
+    if (ptr == NULL) return memory_alloc(size, tag);
+
+    MemoryHeader* header   = memory_header(ptr);
+    u64           old_size = header->size;
+
+    tag = header->tag;
+
+    MemoryHeader* moved = (MemoryHeader*)Memory_Realloc(header, sizeof(MemoryHeader) + size);
+
+    if (moved == NULL) return NULL;
+
+    moved->size = size;
+
+    // The leak report reads the samples under the lock.
+    if (moved->sample) {
+        std::lock_guard<std::mutex> lock(Memory_Samples_Mutex);
+        moved->sample->size = size;
+    }
+
+    // Signed, a shrinking block lowers the live bytes.
+    memory_count(tag, (s64)size - (s64)old_size, 0);
+
+    return moved + 1;
+}
+
+void memory_free(void* ptr) {
+    if (ptr == NULL) return;
+
+    MemoryHeader* header = memory_header(ptr);
+
+    memory_count(header->tag, -(s64)header->size, -1);
+
+    if (header->sample) memory_sample_free(header->sample);
+
+    header->magic = MEMORY_FREED_MAGIC;
+
+    Memory_Free(header);
+}
+
+s64 memory_live(u32 tag) {
+    return Memory_Stats[tag].live.load(std::memory_order_relaxed);
+}
+
+void memory_frame_report() {
+    for (u32 tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        MemoryTagStats* stats       = &Memory_Stats[tag];
+        s64             live        = stats->live.load(std::memory_order_relaxed);
+        u64             allocations = stats->allocations.load(std::memory_order_relaxed);
+        s64             delta       = live - stats->frame_live;
+
+        if (delta != 0 || allocations != stats->frame_allocations) {
+            fprintf(stderr, "MEMORY: %-10s live %10lld B (%+lld B, %llu allocations this frame), peak %lld B, blocks %lld\n",
+                    memory_tag_name(tag), live, delta, allocations - stats->frame_allocations,
+                    stats->peak.load(std::memory_order_relaxed), stats->blocks.load(std::memory_order_relaxed));
+        }
+
+        stats->frame_live        = live;
+        stats->frame_allocations = allocations;
+    }
+}
+
+void memory_leak_report() {
+    for (u32 tag = 0; tag < MEMORY_TAG_COUNT; tag++) {
+        MemoryTagStats* stats = &Memory_Stats[tag];
+
+        fprintf(stderr, "MEMORY: %-10s still live %lld B in %lld blocks, peak %lld B\n", memory_tag_name(tag),
+                stats->live.load(std::memory_order_relaxed),
+                stats->blocks.load(std::memory_order_relaxed),
+                stats->peak.load(std::memory_order_relaxed));
+    }
+
+    std::lock_guard<std::mutex> lock(Memory_Samples_Mutex);
+
+    for (MemorySample* sample = Memory_Samples; sample; sample = sample->next) {
+        fprintf(stderr, "MEMORY: sampled live block, %llu B, tag %s, allocated at:\n", sample->size, memory_tag_name(sample->tag));
+
+#if defined(MEMORY_BACKTRACE)
+        char** symbols = backtrace_symbols(sample->frames, (int)sample->frames_count);
+
+        for (u32 i = 0; i < sample->frames_count; i++) {
+            fprintf(stderr, "    %s\n", symbols ? symbols[i] : "?");
+        }
+
+        ::free(symbols);
+#else
+        for (u32 i = 0; i < sample->frames_count; i++) {
+            fprintf(stderr, "    %p\n", sample->frames[i]);
+        }
+#endif
+    }
+}
+
+#endif
+
+#endif
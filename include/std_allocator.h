@@ -12,63 +12,44 @@
     #define Allocator_Std_Free(ptr)          ::free(ptr)
 #endif
 
-#ifdef MEMORY_DEBUG
-    #include <unordered_map>
-#endif
-
+// With MEMORY_DEBUG every block goes through memory_alloc and is counted under the tag of the allocator.
+// Blocks keep the tag they were allocated with, so any AllocatorPersistent can free them.
 struct AllocatorPersistent : public Allocator{
-#ifdef MEMORY_DEBUG
-    u64 allocated;
-    std::unordered_map<void*, u64> sizes;
-#endif
-    AllocatorPersistent();
+    u32 tag;
+    AllocatorPersistent(u32 tag = MEMORY_TAG_CONTAINERS);
     ~AllocatorPersistent();
     void* alloc(u64 size) override;
     void* realloc(void* ptr, u64 size) override;
     void  free(void* ptr) override;
 };
 
-inline AllocatorPersistent::AllocatorPersistent() {
-#ifdef MEMORY_DEBUG
-    allocated = 0;
-#endif
+inline AllocatorPersistent::AllocatorPersistent(u32 tag) {
+    this->tag = tag;
 }
 
 inline AllocatorPersistent::~AllocatorPersistent() {
 }
 
 inline void* AllocatorPersistent::alloc(u64 size) {
-    void* data = Allocator_Std_Malloc(size);
-    
 #ifdef MEMORY_DEBUG
-    allocated += size;
-    sizes.insert({data, size});
-#endif  
-    return data;
+    return memory_alloc(size, tag);
+#else
+    return Allocator_Std_Malloc(size);
+#endif
 }
 
 inline void* AllocatorPersistent::realloc(void* ptr, u64 size) {
-    void* data = Allocator_Std_Realloc(ptr, size);
-
 #ifdef MEMORY_DEBUG
-    u64 prev       = sizes[ptr];
-    u64 diff       = size - prev;
-        allocated += diff;
-    if (data != ptr) {
-        sizes.erase(ptr);
-        sizes.insert({data, size});
-    } else {
-        sizes.insert_or_assign(data, size);
-    }
-#endif  
-    return data;
+    return memory_realloc(ptr, size, tag);
+#else
+    return Allocator_Std_Realloc(ptr, size);
+#endif
 }
 
 inline void AllocatorPersistent::free(void* ptr) {
 #ifdef MEMORY_DEBUG
-    u64 size       = sizes[ptr];
-        allocated -= size;
-    sizes.erase(ptr);
-#endif
+    memory_free(ptr);
+#else
     Allocator_Std_Free(ptr);
-}
\ No newline at end of file
+#endif
+}
@@ -18,7 +18,7 @@ export struct String {
     u32        length;
 
     String() = default;
-    String(const char* str, Allocator* allocator = Allocator_Persistent);
+    String(const char* str, Allocator* allocator = Allocator_Text);
 
     char* begin() {
         Assert(text, "Cannot iterate uninitialized string, use string_make or constructor to initialize it.");
@@ -81,18 +81,18 @@ inline String::String(const char* str, Allocator* allocator) {
 // export inline bool operator!=(String lhs, String rhs);
 // export inline bool operator!=(String lhs, const char* rhs);
 
-// export inline String  string_make_empty(u32 len, Allocator* allocator = Allocator_Persistent);
-// export inline String* string_make_empty_ptr(u32 len, Allocator* text_allocator = Allocator_Persistent, Allocator* ptr_allocator = Allocator_Persistent);
-// export inline String  string_make(const char* text, Allocator* allocator = Allocator_Persistent);
-// export inline String* string_make_ptr(const char* text, Allocator* text_allocator = Allocator_Persistent, Allocator* ptr_allocator = Allocator_Persistent);
+// export inline String  string_make_empty(u32 len, Allocator* allocator = Allocator_Text);
+// export inline String* string_make_empty_ptr(u32 len, Allocator* text_allocator = Allocator_Text, Allocator* ptr_allocator = Allocator_Persistent);
+// export inline String  string_make(const char* text, Allocator* allocator = Allocator_Text);
+// export inline String* string_make_ptr(const char* text, Allocator* text_allocator = Allocator_Text, Allocator* ptr_allocator = Allocator_Persistent);
 // export inline void    string_free(String* str);
 
 // export inline bool   string_contains(String* str, const char c);
 // export inline bool   string_ends_with(String* str, const char c);
-// export inline String string_substring(String* str, u32 start, u32 end, Allocator* allocator = Allocator_Persistent);
+// export inline String string_substring(String* str, u32 start, u32 end, Allocator* allocator = Allocator_Text);
 // export inline bool   string_equals(String lhs, String rhs);
 
-// export inline StringBuilder sb_make(u32 len = STRING_BUILDER_INITIAL_LENGTH, Allocator* allocator = Allocator_Persistent);
+// export inline StringBuilder sb_make(u32 len = STRING_BUILDER_INITIAL_LENGTH, Allocator* allocator = Allocator_Text);
 // export inline void    sb_realloc(StringBuilder* sb, const u32 len);
 // export inline void    sb_free(StringBuilder* sb);
 // export inline void    sb_append(StringBuilder* sb, const char c);
@@ -102,12 +102,12 @@ inline String::String(const char* str, Allocator* allocator) {
 // export inline void    sb_append_line(StringBuilder* sb, const String str);
 // export inline void    sb_append_line(StringBuilder* sb, const char* str);
 // export inline void    sb_clear(StringBuilder* sb);
-// export inline String  sb_to_string(StringBuilder* sb, Allocator* allocator = Allocator_Persistent);
-// export inline String* sb_to_string_ptr(StringBuilder* sb, Allocator* text_allocator = Allocator_Persistent, Allocator* ptr_allocator = Allocator_Persistent);
-// export inline char*   sb_to_cstring(StringBuilder* sb, Allocator* allocator = Allocator_Persistent);
+// export inline String  sb_to_string(StringBuilder* sb, Allocator* allocator = Allocator_Text);
+// export inline String* sb_to_string_ptr(StringBuilder* sb, Allocator* text_allocator = Allocator_Text, Allocator* ptr_allocator = Allocator_Persistent);
+// export inline char*   sb_to_cstring(StringBuilder* sb, Allocator* allocator = Allocator_Text);
 
 export inline u64 get_hash(String string) {
-    return get_hash(string.text);
+    return hash_bytes(string.text, string.length);
 }
 
 
@@ -141,7 +141,7 @@ export inline bool operator!=(String lhs, const char* rhs) {
     return !(lhs == rhs);
 }
 
-export inline String string_make_empty(u32 len, Allocator* allocator = Allocator_Persistent) {
+export inline String string_make_empty(u32 len, Allocator* allocator = Allocator_Text) {
     String str{};
 
     str.allocator = allocator;
@@ -155,7 +155,7 @@ export inline String string_make_empty(u32 len, Allocator* allocator = Allocator
     return str;
 }
 
-export inline String* string_make_empty_ptr(u32 len, Allocator* text_allocator = Allocator_Persistent, Allocator* ptr_allocator = Allocator_Persistent) {
+export inline String* string_make_empty_ptr(u32 len, Allocator* text_allocator = Allocator_Text, Allocator* ptr_allocator = Allocator_Persistent) {
     String* str = AllocatorAlloc(String, ptr_allocator, sizeof(String));
 
     str->allocator = text_allocator;
@@ -169,7 +169,7 @@ export inline String* string_make_empty_ptr(u32 len, Allocator* text_allocator =
     return str;
 }
 
-export inline String string_make(const char* text, Allocator* allocator = Allocator_Persistent) {
+export inline String string_make(const char* text, Allocator* allocator = Allocator_Text) {
     u32 len = strlen(text);
 
     String str{};
@@ -191,7 +191,7 @@ export inline String string_make(const char* text, Allocator* allocator = Alloca
     return str;
 }
 
-export inline String* string_make_ptr(const char* text, Allocator* text_allocator = Allocator_Persistent, Allocator* ptr_allocator = Allocator_Persistent) {
+export inline String* string_make_ptr(const char* text, Allocator* text_allocator = Allocator_Text, Allocator* ptr_allocator = Allocator_Persistent) {
     String* str = AllocatorAlloc(String, ptr_allocator, sizeof(String));
     
     u32 len = strlen(text);
@@ -258,7 +258,7 @@ export inline bool string_equals(String lhs, String rhs) {
     return true;
 }
 
-export inline StringBuilder sb_make(u32 len = STRING_BUILDER_INITIAL_LENGTH, Allocator* allocator = Allocator_Persistent) {
+export inline StringBuilder sb_make(u32 len = STRING_BUILDER_INITIAL_LENGTH, Allocator* allocator = Allocator_Text) {
     StringBuilder sb;
 
     sb.allocator = allocator;
@@ -338,7 +338,7 @@ export inline void sb_clear(StringBuilder* sb) {
     sb->count = 0;
 }
 
-export inline String sb_to_string(StringBuilder* sb, Allocator* allocator = Allocator_Persistent) {
+export inline String sb_to_string(StringBuilder* sb, Allocator* allocator = Allocator_Text) {
     String str = string_make_empty(sb->count, allocator);
 
     for (u32 i = 0; i < sb->count; i++) {
@@ -348,7 +348,7 @@ export inline String sb_to_string(StringBuilder* sb, Allocator* allocator = Allo
     return str;
 }
 
-export inline String* sb_to_string_ptr(StringBuilder* sb, Allocator* text_allocator = Allocator_Persistent, Allocator* ptr_allocator = Allocator_Persistent) {
+export inline String* sb_to_string_ptr(StringBuilder* sb, Allocator* text_allocator = Allocator_Text, Allocator* ptr_allocator = Allocator_Persistent) {
     String* str = string_make_empty_ptr(sb->count, text_allocator, ptr_allocator);
 
     for (u32 i = 0; i < sb->count; i++) {
@@ -358,7 +358,7 @@ export inline String* sb_to_string_ptr(StringBuilder* sb, Allocator* text_alloca
     return str;
 }
 
-export inline char* sb_to_cstring(StringBuilder* sb, Allocator* allocator = Allocator_Persistent) {
+export inline char* sb_to_cstring(StringBuilder* sb, Allocator* allocator = Allocator_Text) {
     char* str = AllocatorAlloc(char, allocator, sizeof(char) * sb->count);
 
     for (u32 i = 0; i < sb->count; i++) {
@@ -2,7 +2,11 @@
 #define TEXT_IMPLEMENTATION
 #define FILE_IMPLEMENTATION
 #define BITMAP_IMPLEMENTATION
+#define JOBS_IMPLEMENTATION
+#define PROFILER_IMPLEMENTATION
 #include "glass.h"
+#include "glass_pacer.h"
+#include "profiler.h"
 #include <cstdio>
 #include "basic.h"
 #include <cstring>
@@ -15,8 +19,14 @@
 #include "game_context.h"
 #include "components.h"
 #include "component_system.h"
+#include "system_scheduler.h"
+#include "transform_hierarchy.h"
+#include "simulation_clock.h"
 #include "file.h"
 #include "context.h"
+#ifdef MEMORY_DEBUG
+#include "arena.h"
+#endif
 
 import list;
 import hash_table;
@@ -34,6 +44,33 @@ import text;
 #define WIDTH  1280
 #define HEIGHT 720
 
+#define HEADLESS_DEFAULT_FRAMES   600
+#define HEADLESS_DEFAULT_ENTITIES 10000
+#define HEADLESS_DEFAULT_DT       (1.0 / 60.0)
+
+#define SPIN_SPEED      0.5f // radians per second, scaled by TestComponent::b
+#define SPIN_JOB_GRAIN  256  // rows per job, a job never spans more than one chunk anyway
+
+// Simulation without a window, input or renderer: main --headless [--frames N] [--entities N] [--dt seconds].
+// A dt of 0 steps with the measured frame time, anything else is a fixed step. 0 frames runs until killed.
+struct HeadlessOptions {
+    bool   enabled;
+    u64    frames;
+    u32    entities;
+    double dt;
+};
+
+// Simulation systems, registered in register_systems and run by game_update on the job system.
+struct SpinSystem {
+    Query          query; // Transform, TestComponent
+    EntityManager* em;
+    float          angle;
+};
+
+struct AgeSystem {
+    Query query; // TestComponent2
+};
+
 Game_Context G_Context{};
 
 Matrix4 VIEW;
@@ -41,7 +78,13 @@ Matrix4 PROJECTION;
 
 Camera  Cam;
 
-static EntityManager em;
+static EntityManager   em;
+static Query           Render_Query;
+static SystemScheduler Systems;
+static TransformHierarchy Hierarchy;
+static SimulationClock Simulation;
+static SpinSystem      Spin;
+static AgeSystem       Age;
 static Material* Active_Material;
 static Shape2D   Shape;
 
@@ -54,7 +97,19 @@ static Transform Test_Transform = {
 static Vector3 Camera_Rotation = vector3_make(0, radians(0.0f), 0);
 static Vector3 Transform_Rotation = vector3_make(0, 0, 0);
 
-static u64 Target_Fps = 75;
+static u64        Target_Fps = 75;
+static GlassPacer Pacer;
+static u64        Profile_Dump_Frame = 0; // --profile-frames, 0 only dumps on F9
+static bool       Exit_Requested     = false;
+
+static void spawn_test_entities(u32 count);
+static void register_systems();
+static void game_update();
+static void simulate_frame();
+static void game_free();
+static void game_shutdown();
+static void profile_frame(Window* window);
+static int  headless_run(HeadlessOptions* options);
 
 static inline float frand01() {
     return (float)rand() / RAND_MAX;
@@ -74,7 +129,51 @@ static inline Vector3 vector3_random(Vector3 min, Vector3 max) {
 }
 
 int main(int argc, char** argv) {
+    HeadlessOptions headless = {
+        .enabled  = false,
+        .frames   = HEADLESS_DEFAULT_FRAMES,
+        .entities = HEADLESS_DEFAULT_ENTITIES,
+        .dt       = HEADLESS_DEFAULT_DT,
+    };
+
+    bool low_latency = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless.enabled = true;
+        } else if (strcmp(argv[i], "--low-latency") == 0) {
+            low_latency = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headless.frames = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--entities") == 0 && i + 1 < argc) {
+            headless.entities = (u32)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dt") == 0 && i + 1 < argc) {
+            headless.dt = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--profile-frames") == 0 && i + 1 < argc) {
+            Profile_Dump_Frame = strtoull(argv[++i], NULL, 10);
+        } else {
+            Errf("Unknown argument %s. Usage: %s [--low-latency] [--headless] [--frames N] [--entities N] [--dt seconds] [--profile-frames N]", argv[i], argv[0]);
+            return 1;
+        }
+    }
+
+    PROFILE_INIT();
+
     entity_manager_make(&em);
+    query_make(&em, &Render_Query, QUERY_MASK(GET_COMPONENT_BIT(WorldTransform), GET_COMPONENT_BIT(Renderer2D)));
+
+    jobs_init();
+    scheduler_make(&Systems, &em);
+    hierarchy_make(&Hierarchy, &em);
+    register_systems();
+    simulation_clock_make(&Simulation);
+
+    G_Context.time.fixed_dt_double = Simulation.step;
+    G_Context.time.fixed_dt        = (float)Simulation.step;
+
+    if (headless.enabled) {
+        return headless_run(&headless);
+    }
 
     const char* name = "Hello";
 
@@ -205,44 +304,22 @@ int main(int argc, char** argv) {
 
     render_set_active_camera(&Cam);
 
-    u64 last_time = glass_query_performance_counter();
-    u64 current_time = 0;
+    u64 max_fps = 1000;
 
-    u64 max_fps           = 1000;
+    glass_pacer_make(&Pacer, (double)Target_Fps, low_latency);
     // float dt_float = 0;
 
-#if MEMORY_DEBUG
-    s64 persistent_memory_this_frame = 0;
-#endif
     while (true) {
+        glass_pacer_begin_frame(&Pacer);
+
+#ifdef MEMORY_DEBUG
+        Arena* arena = static_cast<Arena*>(Allocator_Temp);
+        Logf("Temp memory allocated this frame: %llu B, capacity: %llu B, buckets: %llu.", arena->allocated, arena->total_capacity, arena->buckets_count);
 
-#if MEMORY_DEBUG
-        Arena* arena = static_cast<Arena*>(get_temp_allocator());
-        Logf("Temp memory allocated this frame: %llu B, %lf KB, %lf MB \n"
-             "Total temp memory capacity: %llu B, %lf KB, %lf MB\n"
-             "Buckets allocated: %llu", arena->allocated,
-                                        arena->allocated / 1024.0,
-                                        arena->allocated / 1024.0 / 1024.0,
-                                        arena->total_capacity,
-                                        arena->total_capacity / 1024.0,
-                                        arena->total_capacity / 1024.0 / 1024.0,
-                                        arena->buckets_count);
-
-        AllocatorPersistent* persistent = static_cast<AllocatorPersistent*>(Allocator_Persistent);
-        s64 mem_diff = (s64)persistent->allocated - persistent_memory_this_frame;
-        persistent_memory_this_frame = (s64)persistent->allocated;
-        Logf("Persistent memory allocated totally: %llu B, %lf KB, %lf MB \n"
-             "Persistent memory allocated this frame: %lli B, %lf KB, %lf MB \n",
-                                        persistent->allocated,
-                                        persistent->allocated / 1024.0,
-                                        persistent->allocated / 1024.0 / 1024.0,
-                                        mem_diff,
-                                        mem_diff / 1024.0,
-                                        mem_diff / 1024.0 / 1024.0);
+        memory_frame_report();
 #endif
         free_temp_allocator();
         if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_ESCAPE)) {
-            glass_exit();
             break;
         }
 
@@ -254,10 +331,9 @@ int main(int argc, char** argv) {
             Target_Fps = clamp(Target_Fps, 1ull, max_fps);
         }
 
-        u64 target_frame_time = 1000 / Target_Fps;
+        glass_pacer_set_target(&Pacer, (double)Target_Fps);
 
         if (glass_exit_required()) {
-            glass_exit();
             break;
         }
 
@@ -270,50 +346,75 @@ int main(int argc, char** argv) {
         render_set_camera_matrices(view, proj, Cam.position);
         render_set_time(G_Context.time.dt, G_Context.time.time);
 
-        glass_main_loop();
-
-        current_time = glass_query_performance_counter();
-
-        u64 dt_int = (current_time - last_time) * 1000 / glass_query_performance_frequency();
-        double dt = (double)(current_time - last_time) / glass_query_performance_frequency();
-
-        last_time = current_time;
+        {
+            PROFILE_SCOPE("main_loop");
+            glass_main_loop();
+        }
 
-        u64 sleep_time = target_frame_time - dt_int;
+        // The platform layer asks to exit when rendering or swapping fails.
+        if (Exit_Requested) {
+            break;
+        }
 
-        sleep_time = clamp(sleep_time, 0llu, target_frame_time);
+        glass_pacer_end_frame(&Pacer);
 
-        if (sleep_time > 0) {
-            glass_sleep(sleep_time);
-            current_time = glass_query_performance_counter();
+        profile_frame(G_Context.wnd);
 
-            dt = (double)(current_time - last_time) / glass_query_performance_frequency();
-            last_time = current_time;
-        }
+        double dt = Pacer.frame_ns / 1e9;
 
         G_Context.time.dt_double    = dt;
         G_Context.time.dt           = (float)dt;
         G_Context.time.time_double += dt;
         G_Context.time.time         = (float)G_Context.time.time_double;
 
-        u64 fps = (u64)(1.0l / dt);
+        u64 fps = dt > 0.0 ? (u64)(1.0l / dt) : 0;
 
         char buf[1024];
 
-        sprintf(buf, "fps: %llu, dt:%f, time:%f\n", fps, G_Context.time.dt, G_Context.time.time);
+        sprintf(buf, "fps: %llu, dt:%f, time:%f, p50: %.2f ms, p99: %.2f ms, missed: %llu\n", fps, G_Context.time.dt, G_Context.time.time,
+                glass_pacer_histogram_percentile(&Pacer.frames, 0.5) / 1e6,
+                glass_pacer_histogram_percentile(&Pacer.frames, 0.99) / 1e6,
+                Pacer.missed);
         glass_set_window_title(G_Context.wnd, buf);
     }
 
+    game_shutdown();
+
     return 0;
 }
 
+static void game_free() {
+    hierarchy_free(&Hierarchy);
+    scheduler_free(&Systems);
+    query_free(&em, &Spin.query);
+    query_free(&em, &Age.query);
+    query_free(&em, &Render_Query);
+    jobs_shutdown();
+
+    PROFILE_SHUTDOWN();
+}
+
+// Only stops the main loop, the platform layer calls it from inside glass_main_loop.
 void glass_exit() {
+    Exit_Requested = true;
+}
+
+// Runs once, after the main loop is left.
+static void game_shutdown() {
+    game_free();
+
     render_destroy();
 
     glass_destroy_all_windows();
+
+#ifdef MEMORY_DEBUG
+    memory_leak_report();
+#endif
 }
 
 GlassErrorCode glass_render(Window* window) {
+    PROFILE_FUNCTION();
+
     clear_color_buffer(Vector4(0.3f, 0.3f, 0.1f, 1.0f));
 
     render_shape_2d(Active_Material, &Shape, &Test_Transform);
@@ -331,11 +432,31 @@ GlassErrorCode glass_render(Window* window) {
     //     printf("\n");
     // }
 
-    EntityManager* emp = &em;
+    // Entities come grouped by shape and material, every group is one instanced draw.
+    // Members are mostly in spawn order, so neighbours share a storage and the query is matched once per run of them.
+    BEGIN_ITERATE_SHARED(Renderer2D)
+        ARENA_SCOPE(static_cast<Arena*>(Allocator_Temp));
+
+        Matrix4*          models  = AllocatorCalloc(Matrix4, Allocator_Temp, group_count);
+        u32               count   = 0;
+        ArchetypeStorage* storage = NULL;
+        bool              matches = false;
+
+        for (u32 i = 0; i < group_count; i++) {
+            EntitySlot* slot = &em.entities[group[i]];
+
+            if (slot->storage != storage) {
+                storage = slot->storage;
+                matches = query_matches(&Render_Query, storage->archetype);
+            }
+
+            if (matches == false) continue;
+
+            models[count++] = *hierarchy_render_matrix(&Hierarchy, group[i]);
+        }
 
-    BEGIN_ITERATE_COMPONENTS_2(emp, Transform, Renderer2D)
-    render_shape_2d(Renderer2D_c->material, Renderer2D_c->shape, Transform_c);
-    END_ITERATE_COMPONENTS_2()
+        render_shapes_2d(Renderer2D_c->material, Renderer2D_c->shape, models, count);
+    END_ITERATE_SHARED()
 
     return GLASS_OK;
 }
@@ -456,6 +577,143 @@ void glass_game_code() {
     Test_Transform.rotation = quaternion_euler(Transform_Rotation);
     // Logf("Cam position: %f, %f, %f, rotation: %f", Cam.position.x, Cam.position.y, Cam.position.z, Cam.rotation);
 
+    EntityManager* e = &em;
+
+    if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_SPACE)) {
+        spawn_test_entities(1);
+    }
+
+    if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_T)) {
+        if (Entities.count > 0) {
+            EntityHandle ent = queue_dequeue(&Entities);
+            entity_destroy(e, ent);
+            Logf("Removed %d", ent.id);
+        }
+    }
+
+    if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_Z)) {
+        if (Entities.count > 0) {
+            for(auto ent : Entities) {
+                if (HAS_COMPONENT(TestComponent2, e, ent.id)) {
+                    entity_print_components(e, ent.id);
+                    REMOVE_COMPONENT(TestComponent2, e, ent.id);
+                    break;
+                }
+            }
+        }
+    }
+
+    simulate_frame();
+}
+
+// Runs the fixed steps owed for the last frame time, then interpolates the transforms between the last two steps for rendering.
+// Input above runs once per rendered frame, the simulation runs at Simulation.step whatever the frame rate is.
+static void simulate_frame() {
+    PROFILE_FUNCTION();
+
+    u32 steps = simulation_clock_advance(&Simulation, G_Context.time.dt_double);
+
+    for (u32 i = 0; i < steps; i++) {
+        if (i + 1 == steps) hierarchy_snapshot(&Hierarchy);
+
+        game_update();
+
+        entity_manager_advance_tick(&em);
+    }
+
+    G_Context.time.alpha = Simulation.alpha;
+
+    hierarchy_interpolate(&Hierarchy, Simulation.alpha);
+}
+
+static void spin_range(QueryRange* range, void* data) {
+    SpinSystem*    spin = (SpinSystem*)data;
+    EntityManager* em   = spin->em;
+
+    BEGIN_ITERATE_RANGE_2(range, Transform, TestComponent)
+        Transform_c->rotation = quaternion_angle_axis(spin->angle * TestComponent_c->b + (float)entity, vector3_forward);
+        MARK_CHANGED(Transform, em);
+    END_ITERATE_RANGE()
+}
+
+// Turns every test entity around its forward axis, the entity id gives each one its own phase.
+// Chunks are split into jobs, the system itself is already a job of the scheduler.
+static void spin_system(EntityManager* em, void* data) {
+    SpinSystem* spin = (SpinSystem*)data;
+
+    spin->em     = em;
+    spin->angle += G_Context.time.fixed_dt * SPIN_SPEED;
+
+    query_par_for_each(&spin->query, SPIN_JOB_GRAIN, spin_range, spin);
+}
+
+// TestComponent2::c counts the simulation steps the entity lived.
+static void age_system(EntityManager* em, void* data) {
+    AgeSystem* age = (AgeSystem*)data;
+
+    BEGIN_ITERATE_QUERY(&age->query, TestComponent2)
+        TestComponent2_c->c++;
+        MARK_CHANGED(TestComponent2, em);
+    END_ITERATE_QUERY()
+}
+
+// Spin and age touch different components, so the scheduler runs them in parallel.
+// The hierarchy is not a system, it runs after them in game_update and spreads its levels over the job system itself.
+static void register_systems() {
+    Spin.em    = &em;
+    Spin.angle = 0.0f;
+
+    query_make(&em, &Spin.query, QUERY_MASK(GET_COMPONENT_BIT(Transform), GET_COMPONENT_BIT(TestComponent)));
+    query_make(&em, &Age.query,  QUERY_MASK(GET_COMPONENT_BIT(TestComponent2)));
+
+    scheduler_add(&Systems, "spin", spin_system, &Spin,
+                  QUERY_MASK(GET_COMPONENT_BIT(TestComponent)),
+                  QUERY_MASK(GET_COMPONENT_BIT(Transform)));
+
+    scheduler_add(&Systems, "age", age_system, &Age,
+                  Archetype_Zero,
+                  QUERY_MASK(GET_COMPONENT_BIT(TestComponent2)));
+}
+
+// One simulation step of G_Context.time.fixed_dt, without input or rendering, so headless runs tick exactly the same systems.
+static void game_update() {
+    PROFILE_FUNCTION();
+
+    scheduler_run(&Systems);
+
+    hierarchy_update(&Hierarchy);
+}
+
+// Ends the profiled frame. F8 logs the zones of the last frame, F9 or reaching --profile-frames writes the Chrome trace.
+// Without a window only --profile-frames applies.
+static void profile_frame(Window* window) {
+#ifdef PROFILER_ENABLED
+    static u64  frame     = 0;
+    static bool dump_held = false;
+
+    PROFILE_FRAME();
+    frame++;
+
+    bool print_key = window && glass_is_button_pressed(window, GLASS_SCANCODE_F8);
+    bool dump_key  = window && glass_is_button_pressed(window, GLASS_SCANCODE_F9);
+
+    if (print_key) {
+        PROFILE_PRINT();
+    }
+
+    if ((dump_key && dump_held == false) || frame == Profile_Dump_Frame) {
+        char path[512];
+
+        sprintf(path, "%s%s", glass_get_executable_path(), "profile.json");
+        PROFILE_DUMP(path);
+    }
+
+    dump_held = dump_key;
+#endif
+}
+
+// Random transforms around the origin, every entity is queued for the T and Z keys.
+static void spawn_test_entities(u32 count) {
     const Vector3 min_pos = Vector3 {
         .x = -30.0f,
         .y = -30.0f,
@@ -480,56 +738,108 @@ void glass_game_code() {
         .z = 5.0f
     };
 
-    EntityManager* e = &em;
+    Transform*      transforms = AllocatorAlloc(Transform, Allocator_Temp, sizeof(Transform) * count);
+    TestComponent*  tests      = AllocatorAlloc(TestComponent, Allocator_Temp, sizeof(TestComponent) * count);
+    TestComponent2* tests2     = AllocatorAlloc(TestComponent2, Allocator_Temp, sizeof(TestComponent2) * count);
+    Renderer2D*     renderers  = AllocatorAlloc(Renderer2D, Allocator_Temp, sizeof(Renderer2D) * count);
+    EntityHandle*   handles    = AllocatorAlloc(EntityHandle, Allocator_Temp, sizeof(EntityHandle) * count);
 
-    if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_SPACE)) {
-        EntityHandle ent = entity_create(&em);
+    Assert(transforms && tests && tests2 && renderers && handles, "Cannot allocate memory for spawned entities.");
 
-        Transform trans = {
+    for (u32 i = 0; i < count; i++) {
+        transforms[i] = {
             .position = vector3_random(min_pos, max_pos),
             .rotation = quaternion_angle_axis(radians(frand(-180.0f, 180.0f)), vector3_forward),
             .scale    = vector3_random(min_scale, max_scale),
         };
 
-        TestComponent test = {
+        tests[i] = {
             .a = 2,
             .b = 3
         };
 
-        TestComponent2 test2 = {
+        tests2[i] = {
             .c = 2,
         };
 
-        Renderer2D renderer = {
+        renderers[i] = {
             .shape    = &Shape,
             .material = Active_Material
         };
-
-        ADD_COMPONENT(Transform, e, ent.id, trans);
-        ADD_COMPONENT(TestComponent, e, ent.id, test);
-        ADD_COMPONENT(Renderer2D, e, ent.id, renderer);
-        ADD_COMPONENT(TestComponent2, e, ent.id, test2);
-        
-        queue_enqueue(&Entities, ent);
     }
 
-    if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_T)) {
-        if (Entities.count > 0) {
-            EntityHandle ent = queue_dequeue(&Entities);
-            entity_destroy(e, ent);
-            Logf("Removed %d", ent.id);
-        }
+    Archetype archetype = QUERY_MASK(GET_COMPONENT_BIT(Transform),
+                                     GET_COMPONENT_BIT(WorldTransform),
+                                     GET_COMPONENT_BIT(TestComponent),
+                                     GET_COMPONENT_BIT(Renderer2D),
+                                     GET_COMPONENT_BIT(TestComponent2));
+
+    ComponentSpan spans[] = {
+        COMPONENT_SPAN(Transform,      transforms),
+        COMPONENT_SPAN(TestComponent,  tests),
+        COMPONENT_SPAN(Renderer2D,     renderers),
+        COMPONENT_SPAN(TestComponent2, tests2),
+    };
+
+    entity_create_batch(&em, count, archetype, handles, spans, sizeof(spans) / sizeof(ComponentSpan));
+
+    for (u32 i = 0; i < count; i++) {
+        queue_enqueue(&Entities, handles[i]);
     }
+}
 
-    if (glass_is_button_pressed(G_Context.wnd, GLASS_SCANCODE_Z)) {
-        if (Entities.count > 0) {
-            for(auto ent : Entities) {
-                if (HAS_COMPONENT(TestComponent2, e, ent.id)) {
-                    entity_print_components(e, ent.id);
-                    REMOVE_COMPONENT(TestComponent2, e, ent.id);
-                    break;
-                }
-            }
-        }
+// No window, GL context or shaders are made, frames only run game_update.
+// Nothing sleeps, a fixed dt only decides the simulated time, so the run is as fast as the simulation.
+static int headless_run(HeadlessOptions* options) {
+    Logf("Headless run. Frames: %llu, entities: %u, dt: %f.", options->frames, options->entities, options->dt);
+
+    spawn_test_entities(options->entities);
+    free_temp_allocator();
+
+    u64 frequency  = glass_query_performance_frequency();
+    u64 start_time = glass_query_performance_counter();
+    u64 last_time  = start_time;
+    u64 frame      = 0;
+
+    // Every frame is one simulation step, nothing is rendered, so there is nothing to interpolate.
+    G_Context.time.dt_double       = options->dt > 0.0 ? options->dt : 0.0;
+    G_Context.time.dt              = (float)G_Context.time.dt_double;
+    G_Context.time.fixed_dt_double = G_Context.time.dt_double;
+    G_Context.time.fixed_dt        = G_Context.time.dt;
+    G_Context.time.alpha           = 1.0f;
+
+    for (; options->frames == 0 || frame < options->frames; frame++) {
+        free_temp_allocator();
+
+        game_update();
+
+        entity_manager_advance_tick(&em);
+
+        profile_frame(NULL);
+
+        u64 current_time = glass_query_performance_counter();
+        double dt        = options->dt > 0.0 ? options->dt : (double)(current_time - last_time) / frequency;
+
+        last_time = current_time;
+
+        G_Context.time.dt_double       = dt;
+        G_Context.time.dt              = (float)dt;
+        G_Context.time.fixed_dt_double = dt;
+        G_Context.time.fixed_dt        = (float)dt;
+        G_Context.time.time_double    += dt;
+        G_Context.time.time            = (float)G_Context.time.time_double;
     }
-}
\ No newline at end of file
+
+    double elapsed = (double)(glass_query_performance_counter() - start_time) / frequency;
+
+    Logf("Headless run finished. Frames: %llu, wall time: %f s, %f ms per frame, simulated time: %f s.",
+         frame, elapsed, frame ? elapsed * 1000.0 / frame : 0.0, G_Context.time.time_double);
+
+    game_free();
+
+#ifdef MEMORY_DEBUG
+    memory_leak_report();
+#endif
+
+    return 0;
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include "glass.h"
+#include "types.h"
+#include "assert.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+// CPU frame profiler. Build with PROFILER_ENABLED to compile the zones in, without it every PROFILE_ macro expands to nothing.
+// #define PROFILER_IMPLEMENTATION in exactly one translation unit.
+//
+// PROFILE_SCOPE("name") measures until the end of the scope. The name must outlive the profiler, string literals are fine.
+// Every thread writes finished zones into its own ring buffer, only the owner writes, so recording is
+// two timestamps and a few stores. The main thread reads the rings behind the writers. Every slot carries the index
+// of its zone, a copy, which the owner lapped before or during the read, is dropped instead of exported torn:
+// PROFILE_FRAME() aggregates the zones finished since the last call per name and depth,
+// PROFILE_DUMP(path) writes everything still in the rings as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// On x64 the timestamps are rdtsc, calibrated against glass_query_performance_counter,
+// the counter itself is a system call on some platforms and would cost more than the whole zone.
+
+#define PROFILER_RING_LENGTH  16384 // zones per thread kept for the trace, must be a power of two
+#define PROFILER_MAX_THREADS  64
+#define PROFILER_MAX_STATS    256   // distinct name and depth pairs in one frame, the rest is not aggregated
+#define PROFILER_MAX_FRAMES   1024  // frame boundaries kept for the trace
+
+#ifdef PROFILER_ENABLED
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define PROFILER_TIMESTAMP() __rdtsc()
+#define PROFILER_TSC 1
+#else
+#define PROFILER_TIMESTAMP() glass_query_performance_counter()
+#define PROFILER_TSC 0
+#endif
+
+struct ProfilerEvent {
+    const char* name;
+    u64         begin;
+    u64         end;
+    u32         depth;
+};
+
+// Ring slot, read while its owner may be overwriting it, so every field is a relaxed atomic.
+struct ProfilerSlot {
+    std::atomic<u64>         sequence; // index of the zone in the slot + 1, 0 while it is being written
+    std::atomic<const char*> name;
+    std::atomic<u64>         begin;
+    std::atomic<u64>         end;
+    std::atomic<u32>         depth;
+};
+
+struct alignas(64) ProfilerThread {
+    std::atomic<u64> head;       // zones written, the slot is head % PROFILER_RING_LENGTH
+    u64              aggregated; // zones already aggregated by PROFILE_FRAME, main thread only
+    u32              index;
+    u32              depth;
+    ProfilerSlot     events[PROFILER_RING_LENGTH];
+};
+
+struct ProfilerStat {
+    const char* name;
+    u32         depth;
+    u32         count;
+    u64         ticks;
+    u64         first_begin; // orders the view, parents begin before their children
+};
+
+// Zones finished during the last aggregated frame.
+struct ProfilerFrameStats {
+    ProfilerStat stats[PROFILER_MAX_STATS];
+    u32          count;
+    u64          begin;
+    u64          end;
+    u64          lost;        // zones overwritten before they were aggregated or that did not fit into stats
+};
+
+inline thread_local ProfilerThread* Profiler_Thread = NULL;
+
+void   profiler_init();
+void   profiler_shutdown();
+void   profiler_register_thread();
+void   profiler_frame();                               // main thread, once per frame
+void   profiler_print_frame();
+bool   profiler_dump_chrome_trace(const char* path);   // main thread
+double profiler_ticks_to_ms(u64 ticks);
+ProfilerFrameStats* profiler_frame_stats();
+
+struct ProfilerZone {
+    const char* name;
+    u64         begin;
+
+    ProfilerZone(const char* zone_name) {
+        if (Profiler_Thread == NULL) profiler_register_thread();
+
+        name  = zone_name;
+        Profiler_Thread->depth++;
+        begin = PROFILER_TIMESTAMP();
+    }
+
+    ~ProfilerZone() {
+        u64             end    = PROFILER_TIMESTAMP();
+        ProfilerThread* thread = Profiler_Thread;
+        u64             head   = thread->head.load(std::memory_order_relaxed);
+        ProfilerSlot*   slot   = &thread->events[head & (PROFILER_RING_LENGTH - 1)];
+
+        thread->depth--;
+
+        // A reader, which sees any of the new fields, also sees the cleared sequence.
+        slot->sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot->name.store(name, std::memory_order_relaxed);
+        slot->begin.store(begin, std::memory_order_relaxed);
+        slot->end.store(end, std::memory_order_relaxed);
+        slot->depth.store(thread->depth, std::memory_order_relaxed);
+
+        slot->sequence.store(head + 1, std::memory_order_release);
+        thread->head.store(head + 1, std::memory_order_release);
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT_(a, b)
+
+#define PROFILE_INIT()       profiler_init()
+#define PROFILE_SHUTDOWN()   profiler_shutdown()
+#define PROFILE_SCOPE(name)  ProfilerZone PROFILE_CONCAT(profiler_zone_, __LINE__)(name)
+#define PROFILE_FUNCTION()   PROFILE_SCOPE(__func__)
+#define PROFILE_FRAME()      profiler_frame()
+#define PROFILE_PRINT()      profiler_print_frame()
+#define PROFILE_DUMP(path)   profiler_dump_chrome_trace(path)
+
+#ifdef PROFILER_IMPLEMENTATION
+
+static std::atomic<ProfilerThread*> Profiler_Threads[PROFILER_MAX_THREADS];
+static std::atomic<u32>             Profiler_Threads_Count{0};
+static ProfilerFrameStats           Profiler_Frame;
+static u64                          Profiler_Frames[PROFILER_MAX_FRAMES]; // frame boundary timestamps
+static u64                          Profiler_Frames_Count = 0;
+static u64                          Profiler_Start_Ticks;
+static u64                          Profiler_Start_Counter;
+static double                       Profiler_Ticks_Per_Ms;
+
+// Ticks per millisecond over everything since profiler_init, the longer the run the more precise.
+static inline void profiler_calibrate() {
+#if PROFILER_TSC
+    u64 ticks   = PROFILER_TIMESTAMP() - Profiler_Start_Ticks;
+    u64 counter = glass_query_performance_counter() - Profiler_Start_Counter;
+
+    if (counter == 0) return;
+
+    Profiler_Ticks_Per_Ms = (double)ticks / ((double)counter * 1000.0 / glass_query_performance_frequency());
+#endif
+}
+
+void profiler_init() {
+    Profiler_Start_Ticks   = PROFILER_TIMESTAMP();
+    Profiler_Start_Counter = glass_query_performance_counter();
+    Profiler_Ticks_Per_Ms  = glass_query_performance_frequency() / 1000.0;
+
+#if PROFILER_TSC
+    // First estimate, refined on every frame.
+    u64 frequency = glass_query_performance_frequency();
+
+    while (glass_query_performance_counter() - Profiler_Start_Counter < frequency / 100) {}
+
+    profiler_calibrate();
+#endif
+
+    profiler_register_thread();
+}
+
+// Call it after every profiled thread has stopped.
+void profiler_shutdown() {
+    u32 count = Profiler_Threads_Count.load(std::memory_order_acquire);
+
+    for (u32 i = 0; i < count; i++) {
+        ProfilerThread* thread = Profiler_Threads[i].exchange(NULL);
+
+        delete thread;
+    }
+
+    Profiler_Threads_Count.store(0);
+    Profiler_Thread = NULL;
+}
+
+void profiler_register_thread() {
+    if (Profiler_Thread) return;
+
+    u32 index = Profiler_Threads_Count.fetch_add(1, std::memory_order_acq_rel);
+
+    Assertf(index < PROFILER_MAX_THREADS, "Cannot profile more than %d threads.", PROFILER_MAX_THREADS);
+
+    ProfilerThread* thread = new ProfilerThread();
+
+    thread->head.store(0, std::memory_order_relaxed);
+    thread->aggregated = 0;
+    thread->index      = index;
+    thread->depth      = 0;
+
+    Profiler_Thread = thread;
+    Profiler_Threads[index].store(thread, std::memory_order_release);
+}
+
+double profiler_ticks_to_ms(u64 ticks) {
+    return (double)ticks / Profiler_Ticks_Per_Ms;
+}
+
+// Copies the zone with the index, false if its owner overwrote the slot before or during the copy.
+static inline bool profiler_read_event(ProfilerThread* thread, u64 index, ProfilerEvent* event) {
+    ProfilerSlot* slot = &thread->events[index & (PROFILER_RING_LENGTH - 1)];
+
+    if (slot->sequence.load(std::memory_order_acquire) != index + 1) return false;
+
+    event->name  = slot->name.load(std::memory_order_relaxed);
+    event->begin = slot->begin.load(std::memory_order_relaxed);
+    event->end   = slot->end.load(std::memory_order_relaxed);
+    event->depth = slot->depth.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return slot->sequence.load(std::memory_order_relaxed) == index + 1;
+}
+
+static inline void profiler_frame_add(const ProfilerEvent* event) {
+    ProfilerFrameStats* frame = &Profiler_Frame;
+
+    for (u32 i = 0; i < frame->count; i++) {
+        ProfilerStat* stat = &frame->stats[i];
+
+        if (stat->name != event->name || stat->depth != event->depth) continue;
+
+        stat->count++;
+        stat->ticks += event->end - event->begin;
+
+        if (event->begin < stat->first_begin) stat->first_begin = event->begin;
+
+        return;
+    }
+
+    if (frame->count == PROFILER_MAX_STATS) {
+        frame->lost++;
+        return;
+    }
+
+    frame->stats[frame->count++] = {
+        .name        = event->name,
+        .depth       = event->depth,
+        .count       = 1,
+        .ticks       = event->end - event->begin,
+        .first_begin = event->begin,
+    };
+}
+
+void profiler_frame() {
+    u64 now = PROFILER_TIMESTAMP();
+
+    Profiler_Frame.begin = Profiler_Frames_Count > 0 ? Profiler_Frames[(Profiler_Frames_Count - 1) % PROFILER_MAX_FRAMES] : Profiler_Start_Ticks;
+    Profiler_Frame.end   = now;
+    Profiler_Frame.count = 0;
+    Profiler_Frame.lost  = 0;
+
+    Profiler_Frames[Profiler_Frames_Count % PROFILER_MAX_FRAMES] = now;
+    Profiler_Frames_Count++;
+
+    u32 count = Profiler_Threads_Count.load(std::memory_order_acquire);
+
+    for (u32 i = 0; i < count; i++) {
+        ProfilerThread* thread = Profiler_Threads[i].load(std::memory_order_acquire);
+
+        if (thread == NULL) continue;
+
+        u64 head   = thread->head.load(std::memory_order_acquire);
+        u64 cursor = thread->aggregated;
+
+        if (head - cursor > PROFILER_RING_LENGTH) {
+            Profiler_Frame.lost += head - cursor - PROFILER_RING_LENGTH;
+            cursor               = head - PROFILER_RING_LENGTH;
+        }
+
+        for (; cursor < head; cursor++) {
+            ProfilerEvent event;
+
+            if (profiler_read_event(thread, cursor, &event) == false) {
+                Profiler_Frame.lost++;
+                continue;
+            }
+
+            profiler_frame_add(&event);
+        }
+
+        thread->aggregated = head;
+    }
+
+    // Insertion sort, there are only a few distinct zones.
+    ProfilerStat* stats = Profiler_Frame.stats;
+
+    for (u32 i = 1; i < Profiler_Frame.count; i++) {
+        ProfilerStat stat = stats[i];
+        u32          j    = i;
+
+        for (; j > 0 && stats[j - 1].first_begin > stat.first_begin; j--) {
+            stats[j] = stats[j - 1];
+        }
+
+        stats[j] = stat;
+    }
+
+    profiler_calibrate();
+}
+
+ProfilerFrameStats* profiler_frame_stats() {
+    return &Profiler_Frame;
+}
+
+void profiler_print_frame() {
+    ProfilerFrameStats* frame = &Profiler_Frame;
+
+    Logf("Profiler frame: %.3f ms, zones lost: %llu.", profiler_ticks_to_ms(frame->end - frame->begin), frame->lost);
+
+    for (u32 i = 0; i < frame->count; i++) {
+        ProfilerStat* stat = &frame->stats[i];
+
+        Logf("%*s%s: %.3f ms, %u calls.", stat->depth * 2, "", stat->name, profiler_ticks_to_ms(stat->ticks), stat->count);
+    }
+}
+
+static inline double profiler_trace_us(u64 ticks) {
+    return profiler_ticks_to_ms(ticks - Profiler_Start_Ticks) * 1000.0;
+}
+
+// Zones still inside the rings are exported, other threads may keep recording, the zones they overwrite meanwhile are skipped.
+bool profiler_dump_chrome_trace(const char* path) {
+    FILE*   file = NULL;
+    errno_t err  = fopen_s(&file, path, "wb");
+
+    if (err != 0 || file == NULL) {
+        Errf("Cannot open %s for the profiler trace.", path);
+        return false;
+    }
+
+    profiler_calibrate();
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"game\"}}");
+
+    u32 count = Profiler_Threads_Count.load(std::memory_order_acquire);
+
+    for (u32 i = 0; i < count; i++) {
+        ProfilerThread* thread = Profiler_Threads[i].load(std::memory_order_acquire);
+
+        if (thread == NULL) continue;
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+                thread->index, thread->index == 0 ? "main" : "thread", thread->index);
+
+        u64 head  = thread->head.load(std::memory_order_acquire);
+        u64 first = head > PROFILER_RING_LENGTH ? head - PROFILER_RING_LENGTH : 0;
+
+        for (u64 cursor = first; cursor < head; cursor++) {
+            ProfilerEvent event;
+
+            if (profiler_read_event(thread, cursor, &event) == false) continue;
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, thread->index, profiler_trace_us(event.begin), profiler_ticks_to_ms(event.end - event.begin) * 1000.0);
+        }
+    }
+
+    u64 frames_first = Profiler_Frames_Count > PROFILER_MAX_FRAMES ? Profiler_Frames_Count - PROFILER_MAX_FRAMES : 0;
+
+    for (u64 frame = frames_first; frame < Profiler_Frames_Count; frame++) {
+        fprintf(file, ",\n{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":0,\"ts\":%.3f}",
+                profiler_trace_us(Profiler_Frames[frame % PROFILER_MAX_FRAMES]));
+    }
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    Logf("Profiler trace written to %s.", path);
+
+    return true;
+}
+
+#endif
+
+#else
+
+#define PROFILE_INIT()
+#define PROFILE_SHUTDOWN()
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#define PROFILE_FRAME()
+#define PROFILE_PRINT()
+#define PROFILE_DUMP(path)
+
+#endif
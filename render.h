@@ -36,6 +36,11 @@ struct Transform {
     // float   rotation;
 };
 
+// Written by the transform hierarchy from Transform and the Parent chain.
+struct WorldTransform {
+    Matrix4 matrix;
+};
+
 struct Renderer2D {
     Shape2D*  shape;
     Material* material;
@@ -58,6 +63,8 @@ void render_set_time(float dt, float time);
 
 void        clear_color_buffer(Vector4 color);
 RenderError render_shape_2d(Material* mat, Shape2D* shape, Transform* transform);
+RenderError render_shape_2d(Material* mat, Shape2D* shape, const Matrix4& model);
+RenderError render_shapes_2d(Material* mat, Shape2D* shape, const Matrix4* models, u32 count); // one instanced draw
 
 void material_set_matrix(Material* mat, String name, Matrix4 data);
 void material_set_matrix(Material* mat, u32 location, Matrix4 data);
@@ -0,0 +1,92 @@
+#include "render.h"
+#include "basic.h"
+#include "assert.h"
+
+import matrix4;
+import text;
+
+// Render backend without a graphics context, the headless target links it instead of render_opengl.cpp.
+// Shaders and materials are empty handles, so game code runs unchanged, and every draw is dropped.
+
+struct Shader {
+    String name;
+};
+
+struct Material {
+    Shader* shader;
+};
+
+static Camera* Active_Camera;
+
+RenderError render_init(Game_Context* ctx) {
+    return RENDER_OK;
+}
+
+void render_destroy() {
+}
+
+RenderError render_test() {
+    return RENDER_OK;
+}
+
+void render_set_active_camera(Camera* cam) {
+    Active_Camera = cam;
+}
+
+void render_set_camera_matrices(Matrix4 v, Matrix4 p, Vector3 pos) {
+}
+
+void render_set_time(float dt, float time) {
+}
+
+void clear_color_buffer(Vector4 color) {
+}
+
+RenderError render_shape_2d(Material* mat, Shape2D* shape, Transform* transform) {
+    return RENDER_OK;
+}
+
+RenderError render_shape_2d(Material* mat, Shape2D* shape, const Matrix4& model) {
+    return RENDER_OK;
+}
+
+RenderError render_shapes_2d(Material* mat, Shape2D* shape, const Matrix4* models, u32 count) {
+    return RENDER_OK;
+}
+
+void material_set_matrix(Material* mat, String name, Matrix4 data) {
+}
+
+void material_set_matrix(Material* mat, u32 location, Matrix4 data) {
+}
+
+s32 material_get_uniform_location(Material* mat, String name) {
+    return -1;
+}
+
+Shader* shader_make(String* vert, String* frag, RenderError* err) {
+    Shader* shader = AllocatorCalloc(Shader, Allocator_Render, 1);
+    Assert(shader, "Cannot allocate shader.");
+
+    *shader = {};
+    *err    = RENDER_OK;
+
+    return shader;
+}
+
+void shader_destroy(Shader* shader) {
+    AllocatorFree(Allocator_Render, shader);
+}
+
+Material* material_make(Shader* shader) {
+    Material* mat = AllocatorCalloc(Material, Allocator_Render, 1);
+    Assert(mat, "Cannot allocate material.");
+
+    mat->shader = shader;
+
+    return mat;
+}
+
+void material_destroy(Material* mat) {
+    AllocatorFree(Allocator_Render, mat);
+}
@@ -64,6 +64,7 @@ Camera*    Active_Camera;
 TimeData   Time_Data;
 u32        Camera_UBO;
 u32        Time_UBO;
+u32        Instance_VBO; // per instance model matrices, refilled by every draw
 
 static inline void use_shader(Shader* shader);
 static inline ShapeCache get_shape_cache(Shape2D* shape);
@@ -71,9 +72,9 @@ static inline ShapeCache get_shape_cache(Shape2D* shape);
 static RenderContext Render_Context{};
 
 RenderError render_init(Game_Context* ctx) {
-    list_make(&Render_Context.shaders);
-    list_make(&Render_Context.materials);
-    table_make(&Render_Context.shape_cache);
+    list_make(&Render_Context.shaders, 256, Allocator_Render);
+    list_make(&Render_Context.materials, 256, Allocator_Render);
+    table_make(&Render_Context.shape_cache, Allocator_Render);
 
     int glad_version = 0;
 #ifdef GLASS_SDL
@@ -105,6 +106,7 @@ RenderError render_init(Game_Context* ctx) {
 
     glGenBuffers(1, &Camera_UBO);
     glGenBuffers(1, &Time_UBO);
+    glGenBuffers(1, &Instance_VBO);
 
     return RENDER_OK;
 }
@@ -189,7 +191,7 @@ Material* material_make(Shader* shader) {
     Material* mat = list_append_empty(&Render_Context.materials);
 
     mat->shader   = shader;
-    mat->uniforms = table_make<String, GLint>();
+    mat->uniforms = table_make<String, GLint>(Allocator_Render);
 
     GLint uniform_count = 0;
     glGetProgramiv(shader->gl_shader, GL_ACTIVE_UNIFORMS, &uniform_count);
@@ -250,23 +252,32 @@ void render_set_time(float dt, float time) {
 }
 
 RenderError render_shape_2d(Material* mat, Shape2D* shape, Transform* transform) {
-    ShapeCache cache = get_shape_cache(shape);
-
     Matrix4 model = matrix4_trs(transform->position,
                                 transform->rotation,
                                 transform->scale);
 
-    // Matrix4 mvp = model * Camera_Data.vp;
-    Matrix4 mvp = Camera_Data.vp * model;
+    return render_shape_2d(mat, shape, model);
+}
+
+RenderError render_shape_2d(Material* mat, Shape2D* shape, const Matrix4& model) {
+    return render_shapes_2d(mat, shape, &model, 1);
+}
+
+// The vertex shader reads the model matrix as an instanced attribute and multiplies it with the camera view_proj.
+RenderError render_shapes_2d(Material* mat, Shape2D* shape, const Matrix4* models, u32 count) {
+    if (count == 0) return RENDER_OK;
+
+    ShapeCache cache = get_shape_cache(shape);
 
     use_shader(mat->shader);
 
     glBindVertexArray(cache.vao);
 
-    material_set_matrix(mat, "model", model);
-    material_set_matrix(mat, "mvp", mvp);
+    // New storage every draw, so the driver does not wait for the previous draw to finish reading the old one.
+    glBindBuffer(GL_ARRAY_BUFFER, Instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Matrix4) * count, models, GL_STREAM_DRAW);
 
-    glDrawElements(GL_TRIANGLES, shape->index_count, GL_UNSIGNED_SHORT, 0);
+    glDrawElementsInstanced(GL_TRIANGLES, shape->index_count, GL_UNSIGNED_SHORT, 0, count);
 
     return RENDER_OK;
 }
@@ -323,6 +334,15 @@ static inline ShapeCache get_shape_cache(Shape2D* shape) {
     glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
     glEnableVertexAttribArray(1);
 
+    // Model matrix, one column per location.
+    glBindBuffer(GL_ARRAY_BUFFER, Instance_VBO);
+
+    for (u32 i = 0; i < 4; i++) {
+        glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Matrix4), (void*)(sizeof(float) * 4 * i));
+        glEnableVertexAttribArray(2 + i);
+        glVertexAttribDivisor(2 + i, 1);
+    }
+
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebobo);
     glBindVertexArray(0);
 
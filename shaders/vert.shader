@@ -2,6 +2,7 @@
 
 layout (location = 0) in vec3 in_pos;
 layout (location = 1) in vec4 in_color;
+layout (location = 2) in mat4 in_model;
 
 layout(std140, binding = 0) uniform Camera {
     mat4 view;
@@ -17,17 +18,12 @@ layout(std140, binding = 1) uniform Time {
    float cos_time;
 } time;
 
-uniform mat4 model;
-uniform mat4 mvp;
-
 layout (location = 0) out vec4 v2f_color;
 
 void main() {
    v2f_color = in_color;
 
-   mat4 m = model;
-
    // gl_Position = vec4(in_pos.x, in_pos.y, in_pos.z, 1.0);
 
-   gl_Position = mvp * vec4(in_pos, 1.0);
+   gl_Position = camera.view_proj * in_model * vec4(in_pos, 1.0);
 }
\ No newline at end of file
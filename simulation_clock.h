@@ -0,0 +1,66 @@
+#pragma once
+
+#include <math.h>
+#include "basic.h"
+#include "assert.h"
+
+// Fixed timestep accumulator. Every rendered frame adds its real duration and gets back how many
+// fixed steps to simulate, the remainder is kept for the next frame and exposed as alpha for interpolation.
+// A frame never runs more than max_steps, the time it could not catch up with is dropped,
+// so a slow frame slows the simulation down instead of making every following frame slower (spiral of death).
+
+#define SIMULATION_DEFAULT_RATE      60   // steps per second
+#define SIMULATION_MAX_STEPS         5    // per rendered frame
+#define SIMULATION_MAX_FRAME_TIME    0.25 // seconds, longer frames (breakpoints, window drags) are clamped
+
+struct SimulationClock {
+    double step;           // fixed dt in seconds
+    double accumulator;    // simulated time behind the real time, less than step after simulation_clock_advance
+    double max_frame_time;
+    double dropped_time;   // total real time the simulation did not catch up with
+    u64    steps;          // total steps taken
+    u32    max_steps;
+    float  alpha;          // accumulator / step, how far the rendered frame is between the last two steps
+};
+
+static inline void simulation_clock_make(SimulationClock* clock, u32 rate = SIMULATION_DEFAULT_RATE) {
+    Assert(rate > 0, "Simulation rate must be positive.");
+
+    clock->step           = 1.0 / rate;
+    clock->accumulator    = 0.0;
+    clock->max_frame_time = SIMULATION_MAX_FRAME_TIME;
+    clock->dropped_time   = 0.0;
+    clock->steps          = 0;
+    clock->max_steps      = SIMULATION_MAX_STEPS;
+    clock->alpha          = 0.0f;
+}
+
+// Returns the number of fixed steps to run for a frame that took frame_time seconds.
+static inline u32 simulation_clock_advance(SimulationClock* clock, double frame_time) {
+    if (frame_time < 0.0)                   frame_time = 0.0;
+    if (frame_time > clock->max_frame_time) {
+        clock->dropped_time += frame_time - clock->max_frame_time;
+        frame_time           = clock->max_frame_time;
+    }
+
+    clock->accumulator += frame_time;
+
+    u32 steps = (u32)(clock->accumulator / clock->step);
+
+    if (steps > clock->max_steps) {
+        double behind = clock->accumulator - clock->max_steps * clock->step;
+
+        // Keep the fraction of a step, so alpha stays continuous while the simulation is behind.
+        clock->dropped_time += behind - fmod(behind, clock->step);
+        clock->accumulator   = clock->max_steps * clock->step + fmod(behind, clock->step);
+        steps                = clock->max_steps;
+    }
+
+    clock->accumulator -= steps * clock->step;
+    clock->steps       += steps;
+    clock->alpha        = (float)(clock->accumulator / clock->step);
+
+    if (clock->alpha > 1.0f) clock->alpha = 1.0f;
+
+    return steps;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "basic.h"
+#include "assert.h"
+#include "component_system.h"
+#include "jobs.h"
+#include "profiler.h"
+
+import list;
+import bitmap;
+
+// A system declares which components it reads and which it writes.
+// Systems, which touch disjoint components (or only read the same ones), run in parallel on the job system,
+// conflicting systems run in the order they were registered.
+// Systems must not do structural changes unless they are exclusive, record them into an EntityCommandBuffer instead.
+
+typedef void (*SystemProc)(EntityManager* em, void* data);
+
+struct System {
+    const char* name;
+    SystemProc  proc;
+    void*       data;
+    Archetype   reads;
+    Archetype   writes;
+    bool        exclusive;          // runs alone, every other system is ordered around it
+    u32         dependencies_count;
+    u32         dependents_first;   // range inside SystemScheduler::dependents
+    u32         dependents_count;
+};
+
+struct SystemScheduler;
+
+struct SystemJob {
+    SystemScheduler* scheduler;
+    u32              index;
+};
+
+struct SystemScheduler {
+    EntityManager*    em;
+    List<System>      systems;
+    List<u32>         dependents;
+    List<SystemJob>   jobs;
+    std::atomic<u32>* pending;    // unfinished dependencies per system, one counter per system
+    JobCounter        counter;
+    bool              dirty;
+};
+
+static inline void scheduler_make(SystemScheduler* scheduler, EntityManager* em);
+static inline void scheduler_free(SystemScheduler* scheduler);
+static inline u32  scheduler_add(SystemScheduler* scheduler, const char* name, SystemProc proc, void* data, Archetype reads, Archetype writes, bool exclusive = false);
+static inline void scheduler_build(SystemScheduler* scheduler);
+static inline void scheduler_run(SystemScheduler* scheduler);
+
+static inline bool system_conflicts(System* a, System* b) {
+    if (a->exclusive || b->exclusive) return true;
+
+    if (bitmap_intersects(a->writes, b->writes)) return true;
+    if (bitmap_intersects(a->writes, b->reads))  return true;
+    if (bitmap_intersects(a->reads,  b->writes)) return true;
+
+    return false;
+}
+
+static inline void scheduler_make(SystemScheduler* scheduler, EntityManager* em) {
+    scheduler->em         = em;
+    scheduler->systems    = list_make<System>(32);
+    scheduler->dependents = list_make<u32>(128);
+    scheduler->jobs       = list_make<SystemJob>(32);
+    scheduler->pending    = NULL;
+    scheduler->dirty      = true;
+    scheduler->counter.value.store(0);
+}
+
+static inline void scheduler_free(SystemScheduler* scheduler) {
+    list_free(&scheduler->systems);
+    list_free(&scheduler->dependents);
+    list_free(&scheduler->jobs);
+
+    if (scheduler->pending) AllocatorFree(Allocator_Persistent, scheduler->pending);
+
+    scheduler->pending = NULL;
+}
+
+static inline u32 scheduler_add(SystemScheduler* scheduler, const char* name, SystemProc proc, void* data, Archetype reads, Archetype writes, bool exclusive) {
+    Assert(proc, "Cannot add a system without a procedure.");
+
+    System system = {
+        .name      = name,
+        .proc      = proc,
+        .data      = data,
+        .reads     = reads,
+        .writes    = writes,
+        .exclusive = exclusive,
+    };
+
+    scheduler->dirty = true;
+
+    return list_append(&scheduler->systems, system);
+}
+
+// Builds the dependency graph: a system depends on every earlier registered system it conflicts with.
+// The graph only changes when systems are added, so it is rebuilt lazily.
+static inline void scheduler_build(SystemScheduler* scheduler) {
+    u32     count   = scheduler->systems.count;
+    System* systems = scheduler->systems.data;
+
+    list_flush(&scheduler->dependents);
+    list_flush(&scheduler->jobs);
+
+    for (u32 i = 0; i < count; i++) {
+        systems[i].dependencies_count = 0;
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        systems[i].dependents_first = scheduler->dependents.count;
+        systems[i].dependents_count = 0;
+
+        for (u32 j = i + 1; j < count; j++) {
+            if (system_conflicts(&systems[i], &systems[j])) {
+                list_append(&scheduler->dependents, j);
+                systems[i].dependents_count++;
+                systems[j].dependencies_count++;
+            }
+        }
+
+        SystemJob job = {
+            .scheduler = scheduler,
+            .index     = i,
+        };
+
+        list_append(&scheduler->jobs, job);
+    }
+
+    if (scheduler->pending) AllocatorFree(Allocator_Persistent, scheduler->pending);
+
+    // Every counter is stored by scheduler_run before any job reads it.
+    scheduler->pending = AllocatorCalloc(std::atomic<u32>, Allocator_Persistent, count > 0 ? count : 1);
+    scheduler->dirty   = false;
+
+    Assert(scheduler->pending, "Cannot allocate memory for the system scheduler.");
+}
+
+static inline void scheduler_system_job(void* data) {
+    SystemJob*       job       = (SystemJob*)data;
+    SystemScheduler* scheduler = job->scheduler;
+    System*          system    = &scheduler->systems.data[job->index];
+
+    {
+        PROFILE_SCOPE(system->name ? system->name : "system");
+        system->proc(scheduler->em, system->data);
+    }
+
+    for (u32 i = 0; i < system->dependents_count; i++) {
+        u32 dependent = scheduler->dependents.data[system->dependents_first + i];
+
+        if (scheduler->pending[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            jobs_submit({ scheduler_system_job, &scheduler->jobs.data[dependent], &scheduler->counter });
+        }
+    }
+}
+
+// Runs every system once and returns when all of them are done.
+static inline void scheduler_run(SystemScheduler* scheduler) {
+    PROFILE_FUNCTION();
+
+    if (scheduler->dirty) {
+        scheduler_build(scheduler);
+    }
+
+    u32 count = scheduler->systems.count;
+
+    for (u32 i = 0; i < count; i++) {
+        scheduler->pending[i].store(scheduler->systems.data[i].dependencies_count, std::memory_order_relaxed);
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        if (scheduler->systems.data[i].dependencies_count == 0) {
+            jobs_submit({ scheduler_system_job, &scheduler->jobs.data[i], &scheduler->counter });
+        }
+    }
+
+    jobs_wait(&scheduler->counter);
+}
@@ -0,0 +1,455 @@
+#pragma once
+
+#include "basic.h"
+#include "arena.h"
+#include "assert.h"
+#include "render.h"
+#include "component_system.h"
+#include "components.h"
+#include "jobs.h"
+#include "profiler.h"
+
+import list;
+import matrix4;
+
+// Parent/Transform/WorldTransform hierarchy. Transform is local to the Parent entity, WorldTransform is written here.
+// Nodes are stored breadth first, sorted by depth, so a whole level only reads the level above it
+// and is computed in parallel on the job system, one level after another.
+// A node is recomputed if its Transform was written since the last update or its parent was recomputed,
+// untouched subtrees cost one tick compare per node.
+// The order is rebuilt after any structural change or when any Parent was written, rows are cached as pointers.
+// For rendering between fixed simulation steps the local Transforms are snapshotted before the last step
+// and hierarchy_interpolate blends them with the current ones into separate matrices, WorldTransform stays untouched.
+
+#define HIERARCHY_ROOT      u32_max
+#define HIERARCHY_JOB_GRAIN 1024 // nodes of one level per job
+#define HIERARCHY_MAX_DEPTH 4096 // deeper chains are treated as a Parent cycle
+
+struct HierarchyNode {
+    Transform* local;
+    Matrix4*   world;
+    u32*       local_tick;
+    u32*       world_tick;
+    u32*       world_chunk_tick;
+    u32        parent;           // node index, HIERARCHY_ROOT if there is no parent with a WorldTransform
+    Entity     entity;
+};
+
+// Local Transform of an entity before the last simulation step.
+struct TransformSnapshot {
+    Transform local;
+    u32       generation;
+    u32       frame;      // valid only if equal to TransformHierarchy::snapshot_frame
+};
+
+struct TransformHierarchy;
+
+typedef void (*HierarchyRangeProc)(TransformHierarchy* hierarchy, u32 first, u32 count);
+
+struct HierarchyJob {
+    TransformHierarchy* hierarchy;
+    HierarchyRangeProc  proc;
+    u32                 first;
+    u32                 count;
+};
+
+struct TransformHierarchy {
+    EntityManager*          em;
+    Query                   query;                // Transform and WorldTransform, registered in the manager
+    List<HierarchyNode>     nodes;                // sorted by depth
+    List<u32>               levels;               // first node of every depth, the last item is nodes.count
+    List<u8>                dirty;                // node recomputed in the running update or interpolation
+    List<HierarchyJob>      jobs;
+    List<u32>               node_by_entity;       // HIERARCHY_ROOT for entities without a node
+    List<TransformSnapshot> snapshots;            // indexed by entity
+    List<Matrix4>           interpolated;         // render matrices, indexed by node
+    u32                     structure_version;
+    u32                     since;                // tick of the last update, writes after it are recomputed
+    u32                     snapshot_frame;
+    u32                     snapshot_tick;        // locals written at or after it moved in the last step
+    u32                     interpolated_version; // structure version the interpolated matrices belong to
+    float                   alpha;
+    bool                    built;
+    bool                    interpolated_valid;
+};
+
+static inline void hierarchy_make(TransformHierarchy* hierarchy, EntityManager* em);
+static inline void hierarchy_free(TransformHierarchy* hierarchy);
+static inline void hierarchy_build(TransformHierarchy* hierarchy);
+static inline void hierarchy_update(TransformHierarchy* hierarchy);
+static inline void hierarchy_snapshot(TransformHierarchy* hierarchy);
+static inline void hierarchy_interpolate(TransformHierarchy* hierarchy, float alpha);
+static inline Matrix4* hierarchy_render_matrix(TransformHierarchy* hierarchy, Entity entity);
+
+// The hierarchy owns a query, so it has to stay at the same address until hierarchy_free.
+static inline void hierarchy_make(TransformHierarchy* hierarchy, EntityManager* em) {
+    Assert(Transform_s.storage == COMPONENT_STORAGE_CHUNK && WorldTransform_s.storage == COMPONENT_STORAGE_CHUNK,
+           "Transform hierarchy needs chunk stored Transform and WorldTransform.");
+
+    hierarchy->em     = em;
+    hierarchy->nodes  = list_make<HierarchyNode>();
+    hierarchy->levels = list_make<u32>();
+    hierarchy->dirty  = list_make<u8>();
+    hierarchy->jobs   = list_make<HierarchyJob>();
+    hierarchy->since  = 0;
+    hierarchy->built  = false;
+
+    hierarchy->node_by_entity     = list_make<u32>();
+    hierarchy->snapshots          = list_make<TransformSnapshot>();
+    hierarchy->interpolated       = list_make<Matrix4>();
+    hierarchy->snapshot_frame     = 0;
+    hierarchy->snapshot_tick      = 0;
+    hierarchy->alpha              = 1.0f;
+    hierarchy->interpolated_valid = false;
+
+    query_make(em, &hierarchy->query, QUERY_MASK(GET_COMPONENT_BIT(Transform), GET_COMPONENT_BIT(WorldTransform)));
+}
+
+static inline void hierarchy_free(TransformHierarchy* hierarchy) {
+    query_free(hierarchy->em, &hierarchy->query);
+    list_free(&hierarchy->nodes);
+    list_free(&hierarchy->levels);
+    list_free(&hierarchy->dirty);
+    list_free(&hierarchy->jobs);
+    list_free(&hierarchy->node_by_entity);
+    list_free(&hierarchy->snapshots);
+    list_free(&hierarchy->interpolated);
+}
+
+// Collects the query rows, resolves parents and counting sorts the nodes by depth.
+static inline void hierarchy_build(TransformHierarchy* hierarchy) {
+    PROFILE_FUNCTION();
+    // The scratch buffers are released when the build ends, not at the end of the frame.
+    ARENA_SCOPE(static_cast<Arena*>(Allocator_Temp));
+
+    EntityManager* em    = hierarchy->em;
+    u32            count = 0;
+
+    for (ArchetypeStorage* storage : hierarchy->query.archetypes) {
+        count += storage->count;
+    }
+
+    HierarchyNode* unsorted       = AllocatorAlloc(HierarchyNode, Allocator_Temp, sizeof(HierarchyNode) * (count + 1));
+    Entity*        entities       = AllocatorAlloc(Entity, Allocator_Temp, sizeof(Entity) * (count + 1));
+    u32*           depths         = AllocatorAlloc(u32, Allocator_Temp, sizeof(u32) * (count + 1));
+    u32*           sorted_index   = AllocatorAlloc(u32, Allocator_Temp, sizeof(u32) * (count + 1));
+    u32            transform_bit  = GET_COMPONENT_BIT(Transform);
+    u32            world_bit      = GET_COMPONENT_BIT(WorldTransform);
+    u32            max_depth      = 0;
+
+    Assert(unsorted && entities && depths && sorted_index, "Cannot allocate memory for the transform hierarchy.");
+
+    if (hierarchy->node_by_entity.length < em->entities_count) list_realloc(&hierarchy->node_by_entity, em->entities_count);
+
+    u32* node_by_entity = hierarchy->node_by_entity.data;
+
+    memset(node_by_entity, 0xFF, sizeof(u32) * em->entities_count);
+    hierarchy->node_by_entity.count = em->entities_count;
+
+    u32 index = 0;
+
+    for (ArchetypeStorage* storage : hierarchy->query.archetypes) {
+        for (u32 chunk = 0; chunk < storage->chunks.count; chunk++) {
+            u32             chunk_count = archetype_storage_chunk_count(storage, chunk);
+            Entity*         ids         = archetype_storage_entities(storage, chunk);
+            Transform*      locals      = (Transform*)archetype_storage_column(storage, chunk, transform_bit);
+            WorldTransform* worlds      = (WorldTransform*)archetype_storage_column(storage, chunk, world_bit);
+            u32*            local_ticks = archetype_storage_ticks(storage, chunk, transform_bit);
+            u32*            world_ticks = archetype_storage_ticks(storage, chunk, world_bit);
+            u32*            chunk_tick  = archetype_storage_chunk_tick(storage, chunk, world_bit);
+
+            for (u32 row = 0; row < chunk_count; row++) {
+                unsorted[index] = {
+                    .local            = &locals[row],
+                    .world            = &worlds[row].matrix,
+                    .local_tick       = &local_ticks[row],
+                    .world_tick       = &world_ticks[row],
+                    .world_chunk_tick = chunk_tick,
+                    .parent           = HIERARCHY_ROOT,
+                    .entity           = ids[row],
+                };
+
+                entities[index]          = ids[row];
+                node_by_entity[ids[row]] = index;
+                depths[index]            = HIERARCHY_ROOT;
+                index++;
+            }
+        }
+    }
+
+    // Parents, which are dead or have no WorldTransform, make the node a root.
+    for (u32 i = 0; i < count; i++) {
+        if (HAS_COMPONENT(Parent, em, entities[i]) == false) continue;
+
+        Parent* parent = GET_COMPONENT(Parent, em, entities[i]);
+
+        if (parent->entity == 0 || parent->entity >= em->entities_count)   continue;
+        if (em->entities[parent->entity].generation != parent->generation) continue;
+        if (node_by_entity[parent->entity] == HIERARCHY_ROOT)              continue;
+
+        unsorted[i].parent = node_by_entity[parent->entity];
+    }
+
+    // Depth of every node, each chain is walked once up to the first node with a known depth.
+    for (u32 i = 0; i < count; i++) {
+        if (depths[i] != HIERARCHY_ROOT) continue;
+
+        u32 node  = i;
+        u32 steps = 0;
+
+        while (depths[node] == HIERARCHY_ROOT && unsorted[node].parent != HIERARCHY_ROOT) {
+            node = unsorted[node].parent;
+            steps++;
+
+            if (steps >= HIERARCHY_MAX_DEPTH) {
+                Assertf(false, "Parent cycle or a chain deeper than %d nodes at entity %d.", HIERARCHY_MAX_DEPTH, entities[i]);
+                unsorted[node].parent = HIERARCHY_ROOT;
+                break;
+            }
+        }
+
+        if (depths[node] == HIERARCHY_ROOT) depths[node] = 0;
+
+        u32 depth = depths[node] + steps;
+
+        for (node = i; depths[node] == HIERARCHY_ROOT; node = unsorted[node].parent) {
+            depths[node] = depth--;
+        }
+
+        if (depths[i] > max_depth) max_depth = depths[i];
+    }
+
+    list_flush(&hierarchy->levels);
+
+    for (u32 depth = 0; depth <= max_depth + 1; depth++) {
+        list_append(&hierarchy->levels, 0u);
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        hierarchy->levels.data[depths[i] + 1]++;
+    }
+
+    for (u32 depth = 1; depth <= max_depth + 1; depth++) {
+        hierarchy->levels.data[depth] += hierarchy->levels.data[depth - 1];
+    }
+
+    // Stable, nodes of one level keep the chunk order.
+    u32* cursor = AllocatorAlloc(u32, Allocator_Temp, sizeof(u32) * (max_depth + 1));
+    Assert(cursor, "Cannot allocate memory for the transform hierarchy.");
+
+    memcpy(cursor, hierarchy->levels.data, sizeof(u32) * (max_depth + 1));
+
+    for (u32 i = 0; i < count; i++) {
+        sorted_index[i] = cursor[depths[i]]++;
+    }
+
+    if (hierarchy->nodes.length < count) list_realloc(&hierarchy->nodes, count);
+    if (hierarchy->dirty.length < count) list_realloc(&hierarchy->dirty, count);
+
+    for (u32 i = 0; i < count; i++) {
+        HierarchyNode node = unsorted[i];
+
+        if (node.parent != HIERARCHY_ROOT) node.parent = sorted_index[node.parent];
+
+        hierarchy->nodes.data[sorted_index[i]] = node;
+        node_by_entity[entities[i]]            = sorted_index[i];
+    }
+
+    hierarchy->nodes.count       = count;
+    hierarchy->dirty.count       = count;
+    hierarchy->structure_version = em->structure_version;
+    hierarchy->built             = true;
+}
+
+static inline void hierarchy_update_range(TransformHierarchy* hierarchy, u32 first, u32 count) {
+    HierarchyNode* nodes = hierarchy->nodes.data;
+    u8*            dirty = hierarchy->dirty.data;
+    u32            since = hierarchy->since;
+    u32            tick  = hierarchy->em->tick;
+
+    for (u32 i = first; i < first + count; i++) {
+        HierarchyNode* node = &nodes[i];
+
+        dirty[i] = *node->local_tick > since || (node->parent != HIERARCHY_ROOT && dirty[node->parent]);
+
+        if (dirty[i] == false) continue;
+
+        Matrix4 local = matrix4_trs(node->local->position, node->local->rotation, node->local->scale);
+
+        *node->world      = node->parent == HIERARCHY_ROOT ? local : matrix4_mul(local, *nodes[node->parent].world);
+        *node->world_tick = tick;
+    }
+}
+
+static inline void hierarchy_job(void* data) {
+    PROFILE_SCOPE("hierarchy_job");
+
+    HierarchyJob* job = (HierarchyJob*)data;
+    job->proc(job->hierarchy, job->first, job->count);
+}
+
+// Runs proc over every level in order, a level only depends on the levels before it.
+static inline void hierarchy_run_levels(TransformHierarchy* hierarchy, HierarchyRangeProc proc) {
+    for (u32 level = 0; level + 1 < hierarchy->levels.count; level++) {
+        u32 first = hierarchy->levels.data[level];
+        u32 count = hierarchy->levels.data[level + 1] - first;
+
+        if (count <= HIERARCHY_JOB_GRAIN || jobs_threads_count() == 1) {
+            proc(hierarchy, first, count);
+            continue;
+        }
+
+        u32 jobs_count = (count + HIERARCHY_JOB_GRAIN - 1) / HIERARCHY_JOB_GRAIN;
+
+        if (hierarchy->jobs.length < jobs_count) list_realloc(&hierarchy->jobs, jobs_count);
+
+        JobCounter counter;
+
+        for (u32 i = 0; i < jobs_count; i++) {
+            HierarchyJob* job = &hierarchy->jobs.data[i];
+
+            job->hierarchy = hierarchy;
+            job->proc      = proc;
+            job->first     = first + i * HIERARCHY_JOB_GRAIN;
+            job->count     = i + 1 < jobs_count ? HIERARCHY_JOB_GRAIN : count - i * HIERARCHY_JOB_GRAIN;
+
+            jobs_submit({ hierarchy_job, job, &counter });
+        }
+
+        // The next level reads the world matrices of this one.
+        jobs_wait(&counter);
+    }
+}
+
+// Call it after the last Transform or Parent write of the tick, later writes in the same tick are not seen.
+static inline void hierarchy_update(TransformHierarchy* hierarchy) {
+    PROFILE_FUNCTION();
+
+    EntityManager* em = hierarchy->em;
+
+    if (hierarchy->built == false ||
+        hierarchy->structure_version != em->structure_version ||
+        component_table_changed_since(&Parent_s, hierarchy->since)) {
+        hierarchy_build(hierarchy);
+        hierarchy->since = 0;
+    }
+
+    hierarchy_run_levels(hierarchy, hierarchy_update_range);
+
+    // Chunk max ticks are shared by many rows, they are raised here instead of inside the jobs.
+    for (u32 i = 0; i < hierarchy->nodes.count; i++) {
+        u32* chunk_tick = hierarchy->nodes.data[i].world_chunk_tick;
+
+        if (hierarchy->dirty.data[i] && *chunk_tick < em->tick) *chunk_tick = em->tick;
+    }
+
+    hierarchy->since = em->tick;
+}
+
+// Call it right before the last simulation step of a frame, only the state before that step is interpolated from.
+// Entities created later have no snapshot and render at their current Transform.
+static inline void hierarchy_snapshot(TransformHierarchy* hierarchy) {
+    PROFILE_FUNCTION();
+
+    EntityManager* em            = hierarchy->em;
+    u32            transform_bit = GET_COMPONENT_BIT(Transform);
+
+    if (hierarchy->snapshots.length < em->entities_count) list_realloc(&hierarchy->snapshots, em->entities_count);
+
+    hierarchy->snapshots.count = em->entities_count;
+    hierarchy->snapshot_frame++;
+    hierarchy->snapshot_tick   = em->tick;
+
+    TransformSnapshot* snapshots = hierarchy->snapshots.data;
+    u32                frame     = hierarchy->snapshot_frame;
+
+    for (ArchetypeStorage* storage : hierarchy->query.archetypes) {
+        for (u32 chunk = 0; chunk < storage->chunks.count; chunk++) {
+            u32        chunk_count = archetype_storage_chunk_count(storage, chunk);
+            Entity*    ids         = archetype_storage_entities(storage, chunk);
+            Transform* locals      = (Transform*)archetype_storage_column(storage, chunk, transform_bit);
+
+            for (u32 row = 0; row < chunk_count; row++) {
+                snapshots[ids[row]] = {
+                    .local      = locals[row],
+                    .generation = em->entities[ids[row]].generation,
+                    .frame      = frame,
+                };
+            }
+        }
+    }
+}
+
+static inline void hierarchy_interpolate_range(TransformHierarchy* hierarchy, u32 first, u32 count) {
+    EntityManager*     em           = hierarchy->em;
+    HierarchyNode*     nodes        = hierarchy->nodes.data;
+    u8*                moved        = hierarchy->dirty.data;
+    Matrix4*           interpolated = hierarchy->interpolated.data;
+    TransformSnapshot* snapshots    = hierarchy->snapshots.data;
+    u32                frame        = hierarchy->snapshot_frame;
+    u32                since        = hierarchy->snapshot_tick;
+    float              alpha        = hierarchy->alpha;
+
+    for (u32 i = first; i < first + count; i++) {
+        HierarchyNode*     node         = &nodes[i];
+        TransformSnapshot* snapshot     = node->entity < hierarchy->snapshots.count ? &snapshots[node->entity] : NULL;
+        bool               has_snapshot = snapshot &&
+                                          snapshot->frame == frame &&
+                                          snapshot->generation == em->entities[node->entity].generation;
+        bool               parent_moved = node->parent != HIERARCHY_ROOT && moved[node->parent];
+
+        moved[i] = (has_snapshot && *node->local_tick >= since) || parent_moved;
+
+        // Nothing on the way to the root moved in the last step, so the world matrix is already exact.
+        if (moved[i] == false) {
+            interpolated[i] = *node->world;
+            continue;
+        }
+
+        Transform local = *node->local;
+
+        if (has_snapshot) {
+            local.position = snapshot->local.position * (1.0f - alpha) + local.position * alpha;
+            local.rotation = nlerp(snapshot->local.rotation, local.rotation, alpha);
+            local.scale    = snapshot->local.scale * (1.0f - alpha) + local.scale * alpha;
+        }
+
+        Matrix4 matrix = matrix4_trs(local.position, local.rotation, local.scale);
+
+        interpolated[i] = node->parent == HIERARCHY_ROOT ? matrix : matrix4_mul(matrix, interpolated[node->parent]);
+    }
+}
+
+// Call it after the simulation steps of a frame with the leftover fraction of a step, 0 renders the snapshot, 1 the current state.
+// Reuses the dirty flags of the update, so it must not run concurrently with hierarchy_update.
+static inline void hierarchy_interpolate(TransformHierarchy* hierarchy, float alpha) {
+    PROFILE_FUNCTION();
+
+    EntityManager* em = hierarchy->em;
+
+    // Rows moved since the last update, the cached pointers are stale until the next step rebuilds them.
+    hierarchy->interpolated_valid = hierarchy->built && hierarchy->structure_version == em->structure_version;
+
+    if (hierarchy->interpolated_valid == false) return;
+
+    if (hierarchy->interpolated.length < hierarchy->nodes.count) list_realloc(&hierarchy->interpolated, hierarchy->nodes.count);
+
+    hierarchy->interpolated.count   = hierarchy->nodes.count;
+    hierarchy->interpolated_version = em->structure_version;
+    hierarchy->alpha                = alpha;
+
+    hierarchy_run_levels(hierarchy, hierarchy_interpolate_range);
+}
+
+// Interpolated matrix of the entity, its WorldTransform if it was not interpolated this frame.
+static inline Matrix4* hierarchy_render_matrix(TransformHierarchy* hierarchy, Entity entity) {
+    EntityManager* em = hierarchy->em;
+
+    if (hierarchy->interpolated_valid && hierarchy->interpolated_version == em->structure_version && entity < hierarchy->node_by_entity.count) {
+        u32 node = hierarchy->node_by_entity.data[entity];
+
+        if (node != HIERARCHY_ROOT) return &hierarchy->interpolated.data[node];
+    }
+
+    return &GET_COMPONENT(WorldTransform, em, entity)->matrix;
+}